@@ -0,0 +1,365 @@
+/* This file holds the auto-tuner: short calibration steps on the actual
+   initial conditions pick the solver and its parameters, and the choice
+   is cached per machine for later runs. */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono> // for timing (clock() adds up the time of every thread)
+#include <fstream> // for the profile file
+#include <sstream> // for std::istringstream
+#include <algorithm> // for std::min, std::max, std::replace
+#include <math.h> // for sqrt, log2, fabs
+#include <unistd.h> // for sysconf
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/system.hpp"
+#include "include/direct_kernel.hpp"
+#include "include/pm.hpp"
+#include "include/autotune.hpp"
+
+
+const char* solver_name(Solver_Type solver) {
+  switch (solver) {
+    case SOLVER_FMM:
+      return "fmm";
+    case SOLVER_PM:
+      return "pm";
+    default:
+      return "direct";
+  }
+}
+
+static int max_threads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+static void set_threads(int num_threads) {
+#ifdef _OPENMP
+  omp_set_num_threads(num_threads);
+#endif
+}
+
+void apply_tuning_profile(System& system, const Tuning_Profile& profile) {
+  system.tree_depth = profile.tree_depth;
+  system.fmm_order = profile.fmm_order;
+  system.pm_grid_size = profile.pm_grid_size;
+  system.pm_split_scale = profile.pm_split_scale;
+  system.direct_tile_size = profile.direct_tile_size;
+  set_threads(profile.num_threads);
+}
+
+
+// Sampled elements and their accelerations, summed directly in double
+struct Reference_Sample {
+  std::vector<int> element_idx;
+  std::vector<double> accel_x, accel_y, accel_z;
+};
+
+static Reference_Sample reference_sample(float ic_data[][NUM_VALUES], const int num_elements) {
+  std::vector<double> x(num_elements), y(num_elements), z(num_elements), mass(num_elements);
+  for (int element = 0; element < num_elements; element++) {
+    x[element] = ic_data[element][0];
+    y[element] = ic_data[element][1];
+    z[element] = ic_data[element][2];
+    mass[element] = ic_data[element][6];
+  }
+
+  // Evenly spaced elements
+  Reference_Sample sample;
+  const int num_samples = std::min(num_elements, AUTOTUNE_SAMPLE_SIZE);
+  for (int i = 0; i < num_samples; i++) {
+    sample.element_idx.push_back((long) i * num_elements / num_samples);
+  }
+  sample.accel_x.resize(num_samples);
+  sample.accel_y.resize(num_samples);
+  sample.accel_z.resize(num_samples);
+
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < num_samples; i++) {
+    const int element = sample.element_idx[i];
+    double accel_x = 0, accel_y = 0, accel_z = 0;
+    direct_acceleration<Double_Precision>(x.data(), y.data(), z.data(), mass.data(), 0, num_elements,
+        x[element], y[element], z[element], accel_x, accel_y, accel_z);
+    sample.accel_x[i] = accel_x;
+    sample.accel_y[i] = accel_y;
+    sample.accel_z[i] = accel_z;
+  }
+  return sample;
+}
+
+// Times one timestep of the profile's solver and measures its force error.
+// The calibration system starts at rest, so the velocity after the step is
+// exactly the force term (G * a * dt), without cancellation against v.
+static void calibrate(const std::vector<float>& calibration_data, const int num_elements, const int num_time_steps,
+    const Reference_Sample* sample, Tuning_Profile& profile) {
+  float (*ic_data)[NUM_VALUES] = reinterpret_cast<float(*)[NUM_VALUES]>(const_cast<float*>(calibration_data.data()));
+  System system(ic_data, num_elements, 2, 1.0);
+  system.diagnostic_interval = 0;
+  apply_tuning_profile(system, profile);
+
+  auto start_time = std::chrono::steady_clock::now();
+  system.start_solver(profile.solver);
+  auto end_time = std::chrono::steady_clock::now();
+  const double setup_time = std::chrono::duration<double>(end_time - start_time).count();
+  profile.tree_depth = system.tree_depth;  // (the PM solver sizes its own leaves)
+
+  // Best of two steps (the first one also warms up the caches and threads)
+  double step_time = 1e30;
+  for (int repetition = 0; repetition < 2; repetition++) {
+    system.current_timestep = 0;
+    start_time = std::chrono::steady_clock::now();
+    system.step();
+    end_time = std::chrono::steady_clock::now();
+    step_time = std::min(step_time, std::chrono::duration<double>(end_time - start_time).count());
+  }
+  profile.step_time = step_time + setup_time / num_time_steps;
+
+  // (no sample when calibrating on a subset of the elements)
+  if (sample == nullptr) {
+    return;
+  }
+  const double scale = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR * system.actual_delta_t;
+  double error_squared = 0, reference_squared = 0;
+  for (int i = 0; i < (int) sample->element_idx.size(); i++) {
+    const int element = sample->element_idx[i];
+    const double dx = system.state.vx[1][element] / scale - sample->accel_x[i];
+    const double dy = system.state.vy[1][element] / scale - sample->accel_y[i];
+    const double dz = system.state.vz[1][element] / scale - sample->accel_z[i];
+    error_squared += dx*dx + dy*dy + dz*dz;
+    reference_squared += sample->accel_x[i] * sample->accel_x[i] + sample->accel_y[i] * sample->accel_y[i] + sample->accel_z[i] * sample->accel_z[i];
+  }
+  profile.force_error = (reference_squared > 0) ? sqrt(error_squared / reference_squared) : 0;
+}
+
+
+// Identifies the machine: cpu model and number of cpus
+static std::string machine_id() {
+  std::string model = "unknown_cpu";
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos) {
+      model = line.substr(line.find(':') + 2);
+      break;
+    }
+  }
+  std::string id = model + "_" + std::to_string(sysconf(_SC_NPROCESSORS_ONLN)) + "cpus";
+  std::replace(id.begin(), id.end(), ' ', '_');
+  return id;
+}
+
+// How clustered the elements are: log2 of the most occupied cell over the
+// mean of the occupied ones, on the grid of the FMM leaves
+static int clustering_bucket(float ic_data[][NUM_VALUES], const int num_elements) {
+  float min[3] = {1e30, 1e30, 1e30}, max[3] = {-1e30, -1e30, -1e30};
+  for (int element = 0; element < num_elements; element++) {
+    for (int axis = 0; axis < 3; axis++) {
+      min[axis] = std::min(min[axis], ic_data[element][axis]);
+      max[axis] = std::max(max[axis], ic_data[element][axis]);
+    }
+  }
+  const int side = 1 << NUM_LAYERS;
+  std::vector<int> counts(side * side * side);
+  for (int element = 0; element < num_elements; element++) {
+    int cell[3];
+    for (int axis = 0; axis < 3; axis++) {
+      const float width = (max[axis] > min[axis]) ? max[axis] - min[axis] : 1;
+      cell[axis] = std::min(side - 1, (int) ((ic_data[element][axis] - min[axis]) / width * side));
+    }
+    counts[cell[0] + side * (cell[1] + side * cell[2])]++;
+  }
+  int occupied = 0, most = 0;
+  for (int count : counts) {
+    occupied += (count > 0);
+    most = std::max(most, count);
+  }
+  return (int) (log2((double) most * occupied / num_elements) + 0.5);
+}
+
+// Key of a profile in the cache file
+static std::string profile_key(float ic_data[][NUM_VALUES], const int num_elements, const double error_budget) {
+  char key[512];
+  snprintf(key, sizeof(key), "%s %d %d %g", machine_id().c_str(), (int) log2((double) num_elements),
+      clustering_bucket(ic_data, num_elements), error_budget);
+  return key;
+}
+
+static bool load_profile(const std::string& key, Tuning_Profile& profile) {
+  std::ifstream file(AUTOTUNE_PROFILE_FILE);
+  std::string line;
+  while (std::getline(file, line)) {
+    // (the key is the first 4 fields)
+    std::istringstream fields(line);
+    std::string machine, elements, clustering, budget, solver;
+    fields >> machine >> elements >> clustering >> budget;
+    if (machine + " " + elements + " " + clustering + " " + budget != key) {
+      continue;
+    }
+    fields >> solver >> profile.tree_depth >> profile.fmm_order >> profile.pm_grid_size >> profile.direct_tile_size
+        >> profile.num_threads >> profile.step_time >> profile.force_error >> profile.pm_split_scale;
+    if (fields.fail()) {
+      continue;
+    }
+    profile.solver = (solver == "fmm") ? SOLVER_FMM : (solver == "pm") ? SOLVER_PM : SOLVER_DIRECT;
+    profile.num_threads = std::min(profile.num_threads, max_threads());
+    return true;
+  }
+  return false;
+}
+
+static void save_profile(const std::string& key, const Tuning_Profile& profile) {
+  // Keep every other profile, replace the one with this key
+  std::vector<std::string> lines;
+  std::ifstream input(AUTOTUNE_PROFILE_FILE);
+  std::string line;
+  while (std::getline(input, line)) {
+    if (line.compare(0, key.size() + 1, key + " ") != 0) {
+      lines.push_back(line);
+    }
+  }
+  input.close();
+
+  char entry[256];
+  snprintf(entry, sizeof(entry), " %s %d %d %d %d %d %e %e %g", solver_name(profile.solver), profile.tree_depth, profile.fmm_order,
+      profile.pm_grid_size, profile.direct_tile_size, profile.num_threads, profile.step_time, profile.force_error, profile.pm_split_scale);
+  lines.push_back(key + entry);
+
+  std::ofstream output(AUTOTUNE_PROFILE_FILE);
+  for (const std::string& profile_line : lines) {
+    output << profile_line << "\n";
+  }
+  if (!output) {
+    printf("Warning: could not write the profile to %s\n", AUTOTUNE_PROFILE_FILE);
+  }
+}
+
+static void print_profile(const char* prefix, const Tuning_Profile& profile) {
+  printf("%s%-6s depth %d order %d grid %3d split %4.2f tile %4d threads %2d: %e seconds per step, force error %e\n", prefix,
+      solver_name(profile.solver), profile.tree_depth, profile.fmm_order, profile.pm_grid_size, profile.pm_split_scale,
+      profile.direct_tile_size, profile.num_threads, profile.step_time, profile.force_error);
+}
+
+
+Tuning_Profile autotune_solver(float ic_data[][NUM_VALUES], const int num_elements, const int num_time_steps, const double error_budget, const bool use_cache) {
+  const std::string key = profile_key(ic_data, num_elements, error_budget);
+  Tuning_Profile best;
+  if (use_cache && load_profile(key, best)) {
+    print_profile("[Autotune] Cached profile: ", best);
+    return best;
+  }
+
+  printf("[Autotune] Calibrating for %d elements (force error budget %g)\n", num_elements, error_budget);
+  auto start_time = std::chrono::steady_clock::now();
+  const int all_threads = max_threads();  // (calibrate changes the OpenMP thread count)
+  const Reference_Sample sample = reference_sample(ic_data, num_elements);
+
+  // The input at rest
+  std::vector<float> calibration_data(ic_data[0], ic_data[0] + num_elements * NUM_VALUES);
+  for (int element = 0; element < num_elements; element++) {
+    calibration_data[element * NUM_VALUES + 3] = 0;
+    calibration_data[element * NUM_VALUES + 4] = 0;
+    calibration_data[element * NUM_VALUES + 5] = 0;
+  }
+
+  // Every candidate with all the threads
+  std::vector<Tuning_Profile> candidates;
+  for (int tile_size : {64, 128, 256, 512, 1024}) {
+    Tuning_Profile profile;
+    profile.solver = SOLVER_DIRECT;
+    profile.direct_tile_size = tile_size;
+    candidates.push_back(profile);
+  }
+  for (int tree_depth : {3, 4, 5}) {
+    for (int order : {3, 4, 5, 6}) {
+      Tuning_Profile profile;
+      profile.solver = SOLVER_FMM;
+      profile.tree_depth = tree_depth;
+      profile.fmm_order = order;
+      candidates.push_back(profile);
+    }
+  }
+  // (the PM solver sizes its leaves to the cutoff, so the split scale is
+  // tuned instead of the depth: a larger one is more accurate and slower)
+  for (int grid_size : {32, 64, 128}) {
+    for (float split_scale : {1.25f, 2.0f, 3.0f}) {
+      // (fewer than 4 leaves across, the short-range sum is nearly direct)
+      if (grid_size - 2 * PM_MARGIN - 1 < 4 * PM_CUTOFF * split_scale) {
+        continue;
+      }
+      Tuning_Profile profile;
+      profile.solver = SOLVER_PM;
+      profile.pm_grid_size = grid_size;
+      profile.pm_split_scale = split_scale;
+      candidates.push_back(profile);
+    }
+  }
+
+  bool found = false;
+  int pm_grid_within = 0;  // grid of the last PM candidate within the budget
+  for (Tuning_Profile& profile : candidates) {
+    profile.num_threads = all_threads;
+    if (profile.solver == SOLVER_PM && profile.pm_grid_size == pm_grid_within) {
+      continue;  // (a larger split on the same grid is only slower)
+    }
+    if (profile.solver == SOLVER_DIRECT && num_elements > AUTOTUNE_DIRECT_LIMIT) {
+      // The direct sum is exact up to rounding, so it is only timed, on the
+      // first AUTOTUNE_DIRECT_LIMIT elements, and scaled up as N^2
+      calibrate(calibration_data, AUTOTUNE_DIRECT_LIMIT, num_time_steps, nullptr, profile);
+      const double ratio = (double) num_elements / AUTOTUNE_DIRECT_LIMIT;
+      profile.step_time *= ratio * ratio;
+      profile.force_error = 0;
+    } else {
+      calibrate(calibration_data, num_elements, num_time_steps, &sample, profile);
+    }
+    print_profile("[Autotune]   ", profile);
+    if (profile.solver == SOLVER_PM && profile.force_error <= error_budget) {
+      pm_grid_within = profile.pm_grid_size;
+    }
+
+    // Fastest within the budget (or the most accurate if none is)
+    const bool within = profile.force_error <= error_budget;
+    const bool best_within = found && best.force_error <= error_budget;
+    if (!found || (within && (!best_within || profile.step_time < best.step_time))
+        || (!within && !best_within && profile.force_error < best.force_error)) {
+      best = profile;
+      found = true;
+    }
+  }
+  if (best.force_error > error_budget) {
+    printf("Warning: no solver meets the force error budget, using the most accurate one\n");
+  }
+
+  // Then the thread count of the chosen settings
+  for (int num_threads = 1; num_threads < all_threads; num_threads *= 2) {
+    Tuning_Profile profile = best;
+    profile.num_threads = num_threads;
+    if (profile.solver == SOLVER_DIRECT && num_elements > AUTOTUNE_DIRECT_LIMIT) {
+      calibrate(calibration_data, AUTOTUNE_DIRECT_LIMIT, num_time_steps, nullptr, profile);
+      const double ratio = (double) num_elements / AUTOTUNE_DIRECT_LIMIT;
+      profile.step_time *= ratio * ratio;
+      profile.force_error = best.force_error;
+    } else {
+      calibrate(calibration_data, num_elements, num_time_steps, &sample, profile);
+    }
+    print_profile("[Autotune]   ", profile);
+    if (profile.step_time < best.step_time) {
+      best = profile;
+    }
+  }
+  set_threads(all_threads);
+
+  auto end_time = std::chrono::steady_clock::now();
+  printf("Done. Time taken: %f seconds.\n", std::chrono::duration<double>(end_time - start_time).count());
+  print_profile("[Autotune] Chosen profile: ", best);
+  save_profile(key, best);
+  return best;
+}
@@ -0,0 +1,107 @@
+/* This file holds the conservation diagnostics
+   (energy, momentum and angular momentum) recorded during a solve. */
+
+#include <iostream>
+#include <string>
+#include <math.h> // for sqrt, fabs
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/system.hpp"
+
+
+void System::record_diagnostics(int curr_timestep) {
+  // Only record every diagnostic_interval timesteps (and the last one)
+  if (this->diagnostic_interval <= 0) {
+    return;
+  }
+  if (curr_timestep % this->diagnostic_interval != 0 && curr_timestep != this->num_time_steps - 1) {
+    return;
+  }
+
+  // Kinetic energy, momentum and angular momentum (summed in double)
+  double kinetic_energy = 0;
+  double px = 0, py = 0, pz = 0;
+  double lx = 0, ly = 0, lz = 0;
+  for (int element = 0; element < this->num_elements; element++) {
+    const double mass = this->state.mass[element];
+    const double x = this->state.x[curr_timestep][element];
+    const double y = this->state.y[curr_timestep][element];
+    const double z = this->state.z[curr_timestep][element];
+    const double vx = this->state.vx[curr_timestep][element];
+    const double vy = this->state.vy[curr_timestep][element];
+    const double vz = this->state.vz[curr_timestep][element];
+
+    kinetic_energy += 0.5 * mass * (vx*vx + vy*vy + vz*vz);
+    px += mass * vx;
+    py += mass * vy;
+    pz += mass * vz;
+    lx += mass * (y * vz - z * vy);
+    ly += mass * (z * vx - x * vz);
+    lz += mass * (x * vy - y * vx);
+  }
+
+  // Potential energy (the FMM keeps this O(N) for large systems)
+  double potential_energy;
+  if (this->num_elements > DIAGNOSTIC_DIRECT_LIMIT) {
+    potential_energy = this->potential_energy_fmm(curr_timestep);
+  } else {
+    potential_energy = this->potential_energy_direct(curr_timestep);
+  }
+
+  Diagnostics_Data& diagnostics = this->diagnostics;
+  diagnostics.timestep.push_back(curr_timestep);
+  diagnostics.kinetic_energy.push_back(kinetic_energy);
+  diagnostics.potential_energy.push_back(potential_energy);
+  diagnostics.total_energy.push_back(kinetic_energy + potential_energy);
+  diagnostics.momentum.insert(diagnostics.momentum.end(), {px, py, pz});
+  diagnostics.angular_momentum.insert(diagnostics.angular_momentum.end(), {lx, ly, lz});
+
+  // Warn as soon as the energy drifts too far (instead of after the run)
+  const double drift = fabs(diagnostics.energy_drift_to(kinetic_energy + potential_energy));
+  if (drift > DIAGNOSTIC_DRIFT_WARNING && !diagnostics.drift_warning_printed) {
+    printf("Warning: %s energy drift of %e at timestep %d\n",
+        (diagnostics.total_energy.front() != 0) ? "relative" : "absolute", drift, curr_timestep);
+    diagnostics.drift_warning_printed = true;
+  }
+}
+
+double System::potential_energy_direct(int curr_timestep) {
+  const double adjusted_constant = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR;
+  double potential_energy = 0;
+
+  // Iterate over each pair of elements
+  for (int element_1 = 0; element_1 < this->num_elements; element_1++) {
+    for (int element_2 = element_1 + 1; element_2 < this->num_elements; element_2++) {
+      const double dx = (double) this->state.x[curr_timestep][element_1] - this->state.x[curr_timestep][element_2];
+      const double dy = (double) this->state.y[curr_timestep][element_1] - this->state.y[curr_timestep][element_2];
+      const double dz = (double) this->state.z[curr_timestep][element_1] - this->state.z[curr_timestep][element_2];
+      const double r = sqrt(dx*dx + dy*dy + dz*dz);
+      if (r > 0) {
+        potential_energy -= adjusted_constant * this->state.mass[element_1] * this->state.mass[element_2] / r;
+      }
+    }
+  }
+  return potential_energy;
+}
+
+void System::print_diagnostics_summary() {
+  const Diagnostics_Data& diagnostics = this->diagnostics;
+  if (diagnostics.num_records() < 2) {
+    return;
+  }
+  const int last = diagnostics.num_records() - 1;
+  const double energy_drift = diagnostics.energy_drift();
+
+  // Absolute change of the total momentum (the initial momentum is often 0)
+  double momentum_change = 0, momentum_scale = 0;
+  for (int i = 0; i < 3; i++) {
+    const double change = diagnostics.momentum[3 * last + i] - diagnostics.momentum[i];
+    momentum_change += change * change;
+    momentum_scale += diagnostics.momentum[i] * diagnostics.momentum[i];
+  }
+
+  printf("Diagnostics (%d records): %s energy drift %e, momentum change %e (initial %e)\n",
+      diagnostics.num_records(), (diagnostics.total_energy[0] != 0) ? "relative" : "absolute",
+      energy_drift, sqrt(momentum_change), sqrt(momentum_scale));
+}
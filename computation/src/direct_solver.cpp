@@ -1,23 +1,27 @@
 #include <iostream>
 #include <string>
-#include <time.h> // for timing
+#include <chrono> // for timing (clock() adds up the time of every thread)
+#include <vector>
 
 #include "include/parameters.hpp"
 #include "include/declarations.hpp"
 #include "include/system.hpp"
+#include "include/direct_kernel.hpp"
 
 
 
 void System::solve_direct() {
   if (this->num_time_steps > 1) {
     printf("[Direct] Solving for %d additional timesteps\n", this->num_time_steps-1);
-    clock_t start_time, end_time;
-    double time_taken;
-    start_time = clock();
+    auto start_time = std::chrono::steady_clock::now();
 
     // this->print_element(0, 0);
     // this->print_element(1, 0);
 
+    // Record the initial energy and momentum (and the reduced output)
+    this->record_diagnostics(0);
+    this->record_reduction(0);
+
     // Iterate over each subsequent timestep
     for (int timestep = 1; timestep < this->num_time_steps; timestep++) {
 
@@ -39,12 +43,18 @@ void System::solve_direct() {
       // (using the updated velocities calculated above)
       this->interpolate_position(timestep);
 
+      // Record the energy and momentum (every diagnostic_interval timesteps)
+      // and the reduced output (every reduction_interval timesteps)
+      this->record_diagnostics(timestep);
+      this->record_reduction(timestep);
+
       // this->print_element(1, timestep);
     }
 
-    end_time = clock();
-    time_taken = double(end_time - start_time) / double(CLOCKS_PER_SEC);
+    auto end_time = std::chrono::steady_clock::now();
+    const double time_taken = std::chrono::duration<double>(end_time - start_time).count();
     printf("Done. Time taken: %f seconds.\n", time_taken);
+    this->print_diagnostics_summary();
 
   } else {
     printf("No additional timesteps to solve for.\n");
@@ -53,32 +63,60 @@ void System::solve_direct() {
 }
 
 void System::update_velocity_direct(int curr_timestep) {
-  // Iterate over each pair of elements
-  for (int element_1 = 0; element_1 < this->num_elements; element_1++) {
-    for (int element_2 = element_1 + 1; element_2 < this->num_elements; element_2++) {
-
-      // Calculate the gravitational force between the two elements
-      float force_x, force_y, force_z;
-      this->calculate_gravitational_force_direct(element_1, element_2, curr_timestep, &force_x, &force_y, &force_z);
-      // printf("Force between elements %d and %d: (%f, %f, %f)\n", element_1, element_2, force_x, force_y, force_z);
-
-      // Update the velocity of each element
-      // Element 1
-      this->state.vx[curr_timestep][element_1] -= (force_x / this->state.mass[element_1]) * this->actual_delta_t;
-      this->state.vy[curr_timestep][element_1] -= (force_y / this->state.mass[element_1]) * this->actual_delta_t;
-      this->state.vz[curr_timestep][element_1] -= (force_z / this->state.mass[element_1]) * this->actual_delta_t;
-
-      // Element 2
-      this->state.vx[curr_timestep][element_2] += (force_x / this->state.mass[element_2]) * this->actual_delta_t;
-      this->state.vy[curr_timestep][element_2] += (force_y / this->state.mass[element_2]) * this->actual_delta_t;
-      this->state.vz[curr_timestep][element_2] += (force_z / this->state.mass[element_2]) * this->actual_delta_t;
-    }
+  // Dispatch to the precision policy chosen at run time
+  switch (this->precision_policy) {
+    case PRECISION_FLOAT:
+      this->update_velocity_direct_tiled<Float_Precision>(curr_timestep);
+      break;
+    case PRECISION_MIXED:
+      this->update_velocity_direct_tiled<Mixed_Precision>(curr_timestep);
+      break;
+    case PRECISION_KAHAN:
+      this->update_velocity_direct_tiled<Kahan_Precision>(curr_timestep);
+      break;
+    case PRECISION_DOUBLE:
+      this->update_velocity_direct_tiled<Double_Precision>(curr_timestep);
+      break;
+  }
+  return;
+}
+
+template <typename Policy>
+void System::update_velocity_direct_tiled(int curr_timestep) {
+  typedef typename Policy::pair_t pair_t;
+  typedef typename Policy::accumulator_t accumulator_t;
+  const pair_t adjusted_constant = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR;
+  const int num_elements = this->num_elements;
+
+  // Copy the positions and masses into contiguous pair_t arrays
+  // (so the inner loop vectorizes whatever real_t is)
+  std::vector<pair_t> x(num_elements), y(num_elements), z(num_elements), mass(num_elements);
+  #pragma omp parallel for schedule(static)
+  for (int element = 0; element < num_elements; element++) {
+    x[element] = this->state.x[curr_timestep][element];
+    y[element] = this->state.y[curr_timestep][element];
+    z[element] = this->state.z[curr_timestep][element];
+    mass[element] = this->state.mass[element];
+  }
+
+  // Every element sums the acceleration from all the others
+  // (each thread updates the velocities of its own static share of the elements)
+  #pragma omp parallel for schedule(static)
+  for (int element_1 = 0; element_1 < num_elements; element_1++) {
+    accumulator_t accel_x = 0, accel_y = 0, accel_z = 0;
+    direct_acceleration<Policy>(x.data(), y.data(), z.data(), mass.data(), 0, num_elements,
+        x[element_1], y[element_1], z[element_1], accel_x, accel_y, accel_z, this->direct_tile_size);
+
+    // Update the velocity of the element
+    this->state.vx[curr_timestep][element_1] += adjusted_constant * static_cast<double>(accel_x) * this->actual_delta_t;
+    this->state.vy[curr_timestep][element_1] += adjusted_constant * static_cast<double>(accel_y) * this->actual_delta_t;
+    this->state.vz[curr_timestep][element_1] += adjusted_constant * static_cast<double>(accel_z) * this->actual_delta_t;
   }
   return;
 }
 
 
-void System::calculate_gravitational_force_direct(int element_1, int element_2, int curr_timestep, float* force_x, float* force_y, float* force_z) {
+void System::calculate_gravitational_force_direct(int element_1, int element_2, int curr_timestep, real_t* force_x, real_t* force_y, real_t* force_z) {
   // Passes the positions and masses of the two elements to the
   // generic Calculate_Gravitational_Force function
   System::Calculate_Gravitational_Force(
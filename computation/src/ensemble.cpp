@@ -0,0 +1,124 @@
+/* This file holds the ensemble solver: many small systems
+   packed together and solved in parallel (one system per thread at a time). */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono> // for timing (clock() adds up the time of every thread)
+#include <algorithm> // for std::max
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/ensemble.hpp"
+#include "include/direct_kernel.hpp"
+
+
+Ensemble::Ensemble(const std::vector<std::vector<float>>& ic_data, const std::vector<std::string>& names, const int num_time_steps, const float delta_t)
+  : num_systems(ic_data.size()), num_time_steps(num_time_steps), total_elements(0), max_elements(0), delta_t(delta_t), names(names) {
+  this->actual_delta_t = delta_t * TIME_SCALING_FACTOR;
+
+  // Pack the systems one after another
+  this->offsets.resize(this->num_systems + 1);
+  for (int system = 0; system < this->num_systems; system++) {
+    const int num_elements = ic_data[system].size() / NUM_VALUES;
+    this->offsets[system] = this->total_elements;
+    this->total_elements += num_elements;
+    this->max_elements = std::max(this->max_elements, num_elements);
+  }
+  this->offsets[this->num_systems] = this->total_elements;
+
+  this->x.resize(this->total_elements);
+  this->y.resize(this->total_elements);
+  this->z.resize(this->total_elements);
+  this->vx.resize(this->total_elements);
+  this->vy.resize(this->total_elements);
+  this->vz.resize(this->total_elements);
+  this->mass.resize(this->total_elements);
+
+  // copy the initial conditions of each system into its slice
+  for (int system = 0; system < this->num_systems; system++) {
+    for (int i = 0; i < this->num_elements(system); i++) {
+      const float* values = &ic_data[system][i * NUM_VALUES];
+      const int element = this->offsets[system] + i;
+      this->x[element] = values[0];
+      this->y[element] = values[1];
+      this->z[element] = values[2];
+      this->vx[element] = values[3];
+      this->vy[element] = values[4];
+      this->vz[element] = values[5];
+      this->mass[element] = values[6];
+    }
+  }
+
+  this->x_history.resize(num_time_steps);
+  this->y_history.resize(num_time_steps);
+  this->z_history.resize(num_time_steps);
+  for (int timestep = 0; timestep < num_time_steps; timestep++) {
+    this->x_history[timestep].resize(this->total_elements);
+    this->y_history[timestep].resize(this->total_elements);
+    this->z_history[timestep].resize(this->total_elements);
+  }
+  this->x_history[0] = this->x;
+  this->y_history[0] = this->y;
+  this->z_history[0] = this->z;
+}
+
+void Ensemble::solve() {
+  if (this->num_time_steps <= 1) {
+    printf("No additional timesteps to solve for.\n");
+    return;
+  }
+  printf("[Ensemble] Solving %d systems (%d elements) for %d additional timesteps\n",
+      this->num_systems, this->total_elements, this->num_time_steps - 1);
+  auto start_time = std::chrono::steady_clock::now();
+
+  // Systems are independent, so each thread takes whole systems
+  // (dynamic, since the systems can have very different sizes)
+  #pragma omp parallel
+  {
+    std::vector<double> accel_x(this->max_elements), accel_y(this->max_elements), accel_z(this->max_elements);
+
+    #pragma omp for schedule(dynamic)
+    for (int system = 0; system < this->num_systems; system++) {
+      this->solve_system(system, accel_x.data(), accel_y.data(), accel_z.data());
+    }
+  }
+
+  auto end_time = std::chrono::steady_clock::now();
+  const double time_taken = std::chrono::duration<double>(end_time - start_time).count();
+  printf("Done. Time taken: %f seconds (%f systems per second).\n", time_taken, this->num_systems / time_taken);
+}
+
+void Ensemble::solve_system(int system, double* accel_x, double* accel_y, double* accel_z) {
+  const double adjusted_constant = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR;
+  const int begin = this->offsets[system];
+  const int end = this->offsets[system + 1];
+
+  // The whole system stays in cache, so it is solved for every
+  // timestep before moving on to the next system
+  for (int timestep = 1; timestep < this->num_time_steps; timestep++) {
+
+    // Accelerations from the positions of the previous timestep
+    for (int element = begin; element < end; element++) {
+      accel_x[element - begin] = 0;
+      accel_y[element - begin] = 0;
+      accel_z[element - begin] = 0;
+      direct_acceleration<Ensemble_Precision>(this->x.data(), this->y.data(), this->z.data(), this->mass.data(), begin, end,
+          this->x[element], this->y[element], this->z[element],
+          accel_x[element - begin], accel_y[element - begin], accel_z[element - begin]);
+    }
+
+    // Update the velocities, then the positions (same scheme as System)
+    for (int element = begin; element < end; element++) {
+      this->vx[element] += adjusted_constant * accel_x[element - begin] * this->actual_delta_t;
+      this->vy[element] += adjusted_constant * accel_y[element - begin] * this->actual_delta_t;
+      this->vz[element] += adjusted_constant * accel_z[element - begin] * this->actual_delta_t;
+      this->x[element] += this->vx[element] * this->actual_delta_t;
+      this->y[element] += this->vy[element] * this->actual_delta_t;
+      this->z[element] += this->vz[element] * this->actual_delta_t;
+      this->x_history[timestep][element] = this->x[element];
+      this->y_history[timestep][element] = this->y[element];
+      this->z_history[timestep][element] = this->z[element];
+    }
+  }
+}
@@ -0,0 +1,152 @@
+/* This file holds the in-tree FFT used by the particle-mesh solver. */
+
+#include <complex>
+#include <vector>
+#include <utility> // for std::swap
+#include <algorithm> // for std::fill
+#include <math.h> // for cos, sin
+
+#include "include/fft.hpp"
+
+
+void fft_1d(std::complex<float>* data, int n, bool inverse) {
+  // Bit reversal permutation
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      std::swap(data[i], data[j]);
+    }
+  }
+
+  // Butterflies (iterative Cooley-Tukey)
+  for (int length = 2; length <= n; length <<= 1) {
+    const double angle = (inverse ? 2 : -2) * M_PI / length;
+    const std::complex<double> step(cos(angle), sin(angle));
+    for (int start = 0; start < n; start += length) {
+      // (the twiddle is kept in double so it does not drift)
+      std::complex<double> twiddle(1, 0);
+      for (int k = 0; k < length / 2; k++) {
+        const std::complex<float> even = data[start + k];
+        const std::complex<float> odd = data[start + k + length / 2] * std::complex<float>(twiddle);
+        data[start + k] = even + odd;
+        data[start + k + length / 2] = even - odd;
+        twiddle *= step;
+      }
+    }
+  }
+}
+
+// Transforms the lines of the half spectrum along y (axis 1) or z (axis 2),
+// for every kx and the other coordinate (z or y) below other_extent
+static void transform_half_spectrum(std::vector<std::complex<float>>& spectrum, int n, int axis, int other_extent, bool inverse) {
+  const int h = n / 2 + 1;
+  const int stride = (axis == 1) ? h : h * n;
+
+  // (lines are independent, each thread takes a static share of them)
+  #pragma omp parallel
+  {
+    std::vector<std::complex<float>> line(n);
+
+    #pragma omp for schedule(static)
+    for (int other = 0; other < other_extent; other++) {
+      for (int kx = 0; kx < h; kx++) {
+        const int base = (axis == 1) ? kx + h * n * other : kx + h * other;
+        for (int i = 0; i < n; i++) {
+          line[i] = spectrum[base + i * stride];
+        }
+        fft_1d(line.data(), n, inverse);
+        for (int i = 0; i < n; i++) {
+          spectrum[base + i * stride] = line[i];
+        }
+      }
+    }
+  }
+}
+
+void fft_3d_real_forward(const std::vector<float>& data, int n, int extent, std::vector<std::complex<float>>& spectrum) {
+  const int h = n / 2 + 1;
+  const int num_lines = extent * extent;  // x lines holding data
+  spectrum.assign(h * n * n, std::complex<float>(0, 0));
+
+  // x lines, two at a time: z = a + i b transforms to Z = A + i B,
+  // and A, B are separated with A[k] = conj(A[n - k]) (likewise B)
+  #pragma omp parallel
+  {
+    std::vector<std::complex<float>> line(n);
+
+    #pragma omp for schedule(static)
+    for (int pair = 0; pair < (num_lines + 1) / 2; pair++) {
+      const int a = 2 * pair;
+      const int b = 2 * pair + 1;
+      const bool has_b = (b < num_lines);
+      std::fill(line.begin(), line.end(), std::complex<float>(0, 0));
+      for (int i = 0; i < extent; i++) {
+        line[i] = std::complex<float>(data[a * extent + i], has_b ? data[b * extent + i] : 0.0f);
+      }
+      fft_1d(line.data(), n, false);
+
+      // (line a is at y = a % extent, z = a / extent)
+      std::complex<float>* out_a = &spectrum[h * ((a % extent) + n * (a / extent))];
+      std::complex<float>* out_b = &spectrum[h * ((b % extent) + n * (b / extent))];
+      for (int k = 0; k < h; k++) {
+        const std::complex<float> z = line[k];
+        const std::complex<float> z_mirror = std::conj(line[(n - k) % n]);
+        out_a[k] = 0.5f * (z + z_mirror);
+        if (has_b) {
+          out_b[k] = std::complex<float>(0, -0.5f) * (z - z_mirror);
+        }
+      }
+    }
+  }
+
+  // y lines (planes past the extent in z are still all zero), then z lines
+  transform_half_spectrum(spectrum, n, 1, extent, false);
+  transform_half_spectrum(spectrum, n, 2, n, false);
+}
+
+void fft_3d_real_inverse(std::vector<std::complex<float>>& spectrum, int n, int extent, std::vector<float>& data) {
+  const int h = n / 2 + 1;
+  const int num_lines = extent * extent;  // x lines that are kept
+  data.resize(extent * extent * extent);
+
+  // z lines, then y lines (only the planes inside the extent in z are kept)
+  transform_half_spectrum(spectrum, n, 2, n, true);
+  transform_half_spectrum(spectrum, n, 1, extent, true);
+
+  // x lines, two at a time: the full spectra of A and B (from
+  // A[n - k] = conj(A[k])) are combined into Z = A + i B, whose
+  // inverse is a + i b
+  #pragma omp parallel
+  {
+    std::vector<std::complex<float>> line(n);
+
+    #pragma omp for schedule(static)
+    for (int pair = 0; pair < (num_lines + 1) / 2; pair++) {
+      const int a = 2 * pair;
+      const int b = 2 * pair + 1;
+      const bool has_b = (b < num_lines);
+      const std::complex<float>* in_a = &spectrum[h * ((a % extent) + n * (a / extent))];
+      const std::complex<float>* in_b = &spectrum[h * ((b % extent) + n * (b / extent))];
+      for (int k = 0; k < n; k++) {
+        const std::complex<float> value_a = (k < h) ? in_a[k] : std::conj(in_a[n - k]);
+        std::complex<float> value_b(0, 0);
+        if (has_b) {
+          value_b = (k < h) ? in_b[k] : std::conj(in_b[n - k]);
+        }
+        line[k] = value_a + std::complex<float>(0, 1) * value_b;
+      }
+      fft_1d(line.data(), n, true);
+
+      for (int i = 0; i < extent; i++) {
+        data[a * extent + i] = line[i].real();
+        if (has_b) {
+          data[b * extent + i] = line[i].imag();
+        }
+      }
+    }
+  }
+}
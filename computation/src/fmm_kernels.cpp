@@ -0,0 +1,139 @@
+/* This file holds the FMM translation operators and the dispatch of the
+   M2L kernel (the kernels themselves are templates in fmm_kernels.hpp).
+   (None of it depends on System, so the benchmarks can use it directly) */
+
+#include <iostream>
+#include <vector>
+#include <math.h> // for sqrt, cos
+
+#include "include/declarations.hpp"
+#include "include/fmm.hpp"
+#include "include/fmm_kernels.hpp"
+
+
+FMM_Operators::FMM_Operators(int order) : order(order), num_nodes(order * order * order) {
+  // 1D Chebyshev nodes (of the first kind)
+  this->nodes.resize(order);
+  for (int k = 0; k < order; k++) {
+    this->nodes[k] = cos(M_PI * (2 * k + 1) / (2.0 * order));
+  }
+
+  const int n = this->num_nodes;
+
+  // M2L: the kernel (1/r) evaluated between the nodes of two unit cells,
+  // for every offset that can show up in an interaction list
+  for (int dz = -M2L_MAX_OFFSET; dz <= M2L_MAX_OFFSET; dz++) {
+    for (int dy = -M2L_MAX_OFFSET; dy <= M2L_MAX_OFFSET; dy++) {
+      for (int dx = -M2L_MAX_OFFSET; dx <= M2L_MAX_OFFSET; dx++) {
+        int& index = this->m2l_index[dx + M2L_MAX_OFFSET][dy + M2L_MAX_OFFSET][dz + M2L_MAX_OFFSET];
+
+        // Neighbors are handled directly (P2P), not by M2L
+        if (abs(dx) <= 1 && abs(dy) <= 1 && abs(dz) <= 1) {
+          index = -1;
+          continue;
+        }
+        index = this->m2l.size();
+        this->m2l_offsets.push_back(dx);
+        this->m2l_offsets.push_back(dy);
+        this->m2l_offsets.push_back(dz);
+
+        // (cells have a width of 2, so the source center is at 2 * offset)
+        std::vector<float> op(n * n);
+        for (int b = 0; b < n; b++) {
+          const float source_x = 2 * dx + this->nodes[b % order];
+          const float source_y = 2 * dy + this->nodes[(b / order) % order];
+          const float source_z = 2 * dz + this->nodes[b / (order * order)];
+          for (int a = 0; a < n; a++) {
+            const float rx = source_x - this->nodes[a % order];
+            const float ry = source_y - this->nodes[(a / order) % order];
+            const float rz = source_z - this->nodes[a / (order * order)];
+            op[b * n + a] = 1.0 / sqrt(rx*rx + ry*ry + rz*rz);
+          }
+        }
+        this->m2l.push_back(op);
+      }
+    }
+  }
+}
+
+FMM_Level::FMM_Level(int layer, int num_nodes) : layer(layer), half_width(0) {
+  this->cells_per_side = 1 << layer;
+  this->num_cells = this->cells_per_side * this->cells_per_side * this->cells_per_side;
+  this->cells.resize(this->num_cells, nullptr);
+  this->occupied.resize(this->num_cells, 0);
+  this->multipole.resize(this->num_cells * num_nodes);
+  this->local.resize(this->num_cells * num_nodes);
+}
+
+
+void fmm_build_interaction_lists(const FMM_Operators& operators, FMM_Level& level) {
+  const int num_offsets = operators.m2l.size();
+  level.m2l_targets.resize(num_offsets);
+  level.m2l_sources.resize(num_offsets);
+  for (int offset = 0; offset < num_offsets; offset++) {
+    level.m2l_targets[offset].clear();
+    level.m2l_sources[offset].clear();
+  }
+
+  const int side = level.cells_per_side;
+  for (int iz = 0; iz < side; iz++) {
+    for (int iy = 0; iy < side; iy++) {
+      for (int ix = 0; ix < side; ix++) {
+        const int target = level.cell_index(ix, iy, iz);
+        if (!level.occupied[target]) {
+          continue;
+        }
+
+        // The interaction list is the children of the parent's neighbors
+        // that are not neighbors themselves
+        for (int jz = 2 * (iz / 2 - 1); jz < 2 * (iz / 2 + 2); jz++) {
+          for (int jy = 2 * (iy / 2 - 1); jy < 2 * (iy / 2 + 2); jy++) {
+            for (int jx = 2 * (ix / 2 - 1); jx < 2 * (ix / 2 + 2); jx++) {
+              if (jx < 0 || jy < 0 || jz < 0 || jx >= side || jy >= side || jz >= side) {
+                continue;
+              }
+              const int source = level.cell_index(jx, jy, jz);
+              if (!level.occupied[source]) {
+                continue;
+              }
+              const int offset = operators.m2l_index[jx - ix + M2L_MAX_OFFSET][jy - iy + M2L_MAX_OFFSET][jz - iz + M2L_MAX_OFFSET];
+              if (offset < 0) {
+                continue;
+              }
+              level.m2l_targets[offset].push_back(target);
+              level.m2l_sources[offset].push_back(source);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+
+void fmm_m2l_batched(const FMM_Operators& operators, FMM_Level& level) {
+  // Dispatch to the kernel compiled for the order
+  switch (operators.order) {
+    case 2:
+      fmm_m2l_batched<2>(operators, level);
+      break;
+    case 3:
+      fmm_m2l_batched<3>(operators, level);
+      break;
+    case 4:
+      fmm_m2l_batched<4>(operators, level);
+      break;
+    case 5:
+      fmm_m2l_batched<5>(operators, level);
+      break;
+    case 6:
+      fmm_m2l_batched<6>(operators, level);
+      break;
+    case 7:
+      fmm_m2l_batched<7>(operators, level);
+      break;
+    case 8:
+      fmm_m2l_batched<8>(operators, level);
+      break;
+  }
+}
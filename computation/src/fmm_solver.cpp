@@ -1,23 +1,33 @@
 #include <iostream>
 #include <string>
-#include <time.h> // for timing
+#include <chrono> // for timing (clock() adds up the time of every thread)
+#include <vector>
+#include <algorithm> // for std::max, std::fill
+#include <math.h> // for sqrt
 
 #include "include/parameters.hpp"
 #include "include/declarations.hpp"
 #include "include/system.hpp"
+#include "include/fmm.hpp"
+#include "include/fmm_kernels.hpp"
 
 
 
 void System::solve_fmm() {
   if (this->num_time_steps > 1) {
     printf("[FMM] Solving for %d additional timesteps\n", this->num_time_steps-1);
-    clock_t start_time, end_time;
-    double time_taken;
-    start_time = clock();
+    auto start_time = std::chrono::steady_clock::now();
+
+    // Build the translation operators and the per-layer views of the tree
+    this->initialize_fmm();
 
     // this->print_element(0, 0);
     // this->print_element(2, 0);
 
+    // Record the initial energy and momentum (and the reduced output)
+    this->record_diagnostics(0);
+    this->record_reduction(0);
+
     // Iterate over each subsequent timestep
     for (int timestep = 1; timestep < this->num_time_steps; timestep++) {
 
@@ -39,11 +49,17 @@ void System::solve_fmm() {
       // Solve for and update the position of each element
       // (using the updated velocities calculated above)
       this->interpolate_position(timestep);
+
+      // Record the energy and momentum (every diagnostic_interval timesteps)
+      // and the reduced output (every reduction_interval timesteps)
+      this->record_diagnostics(timestep);
+      this->record_reduction(timestep);
     }
 
-    end_time = clock();
-    time_taken = double(end_time - start_time) / double(CLOCKS_PER_SEC);
+    auto end_time = std::chrono::steady_clock::now();
+    const double time_taken = std::chrono::duration<double>(end_time - start_time).count();
     printf("Done. Time taken: %f seconds.\n", time_taken);
+    this->print_diagnostics_summary();
 
   } else {
     printf("No additional timesteps to solve for.\n");
@@ -51,6 +67,45 @@ void System::solve_fmm() {
   return;
 }
 
+// Adds the block (and its children) to the flattened per-layer views
+static void register_block_fmm(Block& block, std::vector<FMM_Level>& levels) {
+  FMM_Level& level = levels[block.layer];
+  level.cells[level.cell_index(block.ix, block.iy, block.iz)] = &block;
+  if (block.layer < block.num_layers) {
+    for (int i = 0; i < NUM_BLOCKS_PER_LAYER; i++) {
+      register_block_fmm(block.children[i], levels);
+    }
+  }
+}
+
+void System::build_tree() {
+  // The tree is built with the default depth, rebuild it if tree_depth changed
+  if (this->base_block.num_layers != this->tree_depth) {
+    this->base_block = Block(0, -1, nullptr, this->tree_depth);
+    this->base_block.initialize_parent(nullptr);  // (the children still point at the temporary)
+  }
+}
+
+void System::initialize_fmm() {
+  this->build_tree();
+
+  // Only the orders in FMM_MIN_ORDER..FMM_MAX_ORDER have compiled kernels
+  if (this->fmm_order < FMM_MIN_ORDER || this->fmm_order > FMM_MAX_ORDER) {
+    const int order = std::min(std::max(this->fmm_order, FMM_MIN_ORDER), FMM_MAX_ORDER);
+    printf("FMM order %d has no compiled kernels, using order %d\n", this->fmm_order, order);
+    this->fmm_order = order;
+  }
+
+  // The operators only depend on the order, so they are built once per solve
+  this->fmm_operators = FMM_Operators(this->fmm_order);
+
+  this->fmm_levels.clear();
+  for (int layer = 0; layer <= this->tree_depth; layer++) {
+    this->fmm_levels.emplace_back(layer, this->fmm_operators.num_nodes);
+  }
+  register_block_fmm(this->base_block, this->fmm_levels);
+}
+
 const float boundary_buffer = 0.1;
 void System::decompose_domain_fmm(int curr_timestep) {
   // printf("Decomposing domain for timestep %d\n", curr_timestep);
@@ -89,6 +144,19 @@ void System::decompose_domain_fmm(int curr_timestep) {
   y_max += boundary_buffer;
   z_min -= boundary_buffer;
   z_max += boundary_buffer;
+
+  // Expand the domain into a cube so every block of a layer is the same
+  // cube (the M2L operators are only built for cubic cells)
+  const float half_size = std::max(x_max - x_min, std::max(y_max - y_min, z_max - z_min)) / 2;
+  const float x_center = (x_min + x_max) / 2;
+  const float y_center = (y_min + y_max) / 2;
+  const float z_center = (z_min + z_max) / 2;
+  x_min = x_center - half_size;
+  x_max = x_center + half_size;
+  y_min = y_center - half_size;
+  y_max = y_center + half_size;
+  z_min = z_center - half_size;
+  z_max = z_center + half_size;
   // printf("x_min: %f, x_max: %f, y_min: %f, y_max: %f, z_min: %f, z_max: %f\n", x_min, x_max, y_min, y_max, z_min, z_max);
 
   // this->base_block.x_min = x_min;
@@ -131,7 +199,7 @@ void Block::init_block_recursive(float x_min, float x_max, float y_min, float y_
 
   // printf("[layer %d] %f %f %f %f %f %f\n", layer, this->x_min, this->x_max, this->y_min, this->y_max, this->z_min, this->z_max);
   // Recursively define boundaries for children
-  if (this->layer < NUM_LAYERS) {
+  if (this->layer < this->num_layers) {
     // Bottom half
     // printf("[layer %d] child %d: %f %f %f %f %f %f\n", layer, 0, x_min, x_mid, y_min, y_mid, z_min, z_mid);
     this->children[0].init_block_recursive(x_min, x_mid, y_min, y_mid, z_min, z_mid);
@@ -163,7 +231,7 @@ void Block::add_element(int element_idx, float x, float y, float z, float mass)
     this->num_elements++;
     this->mass += mass;
   }
-  if (this->layer < NUM_LAYERS) {
+  if (this->layer < this->num_layers) {
     
     // x first
     if (x < this->x_mid) {
@@ -205,25 +273,305 @@ void Block::add_element(int element_idx, float x, float y, float z, float mass)
 }
 
 void System::solve_time_step_fmm(int curr_timestep) {
-  // Iterate over each element
-  for (int element = 0; element < this->num_elements; element++) {
-    // Perform one force calculation for each element
-    
-    // TEMP
-    float sign = (curr_timestep % 2 == 0) ? 1 : -1;
-    float force_x, force_y, force_z;
-    int other_element = (int (element * this->state.vy[curr_timestep][element])) % this->num_elements;
-    this->calculate_gravitational_force_direct(element, other_element, curr_timestep, &force_x, &force_y, &force_z);
-
-    // update element velocity
-    this->state.vx[curr_timestep][element] += sign * force_x / this->state.mass[element] * this->actual_delta_t;
-    this->state.vy[curr_timestep][element] += sign * force_y / this->state.mass[element] * this->actual_delta_t;
-    this->state.vz[curr_timestep][element] += sign * force_z / this->state.mass[element] * this->actual_delta_t;
-
-    // apply to other element as well
-    this->state.vx[curr_timestep][other_element] -= sign * force_x / this->state.mass[other_element] * this->actual_delta_t;
-    this->state.vy[curr_timestep][other_element] -= sign * force_y / this->state.mass[other_element] * this->actual_delta_t;
-    this->state.vz[curr_timestep][other_element] -= sign * force_z / this->state.mass[other_element] * this->actual_delta_t;
+  // Dispatch to the kernels compiled for the expansion order
+  switch (this->fmm_operators.order) {
+    case 2:
+      this->solve_time_step_fmm_order<2>(curr_timestep);
+      break;
+    case 3:
+      this->solve_time_step_fmm_order<3>(curr_timestep);
+      break;
+    case 4:
+      this->solve_time_step_fmm_order<4>(curr_timestep);
+      break;
+    case 5:
+      this->solve_time_step_fmm_order<5>(curr_timestep);
+      break;
+    case 6:
+      this->solve_time_step_fmm_order<6>(curr_timestep);
+      break;
+    case 7:
+      this->solve_time_step_fmm_order<7>(curr_timestep);
+      break;
+    case 8:
+      this->solve_time_step_fmm_order<8>(curr_timestep);
+      break;
   }
 }
 
+template <int Order>
+void System::solve_time_step_fmm_order(int curr_timestep) {
+  // Multipole and local expansions of every block
+  this->compute_expansions_fmm<Order>(curr_timestep);
+
+  // L2P for the far field and P2P for the near field
+  // (the pair kernel in the precision policy chosen at run time)
+  switch (this->precision_policy) {
+    case PRECISION_FLOAT:
+      this->evaluate_leaves_fmm<Order, Float_Precision>(curr_timestep);
+      break;
+    case PRECISION_MIXED:
+      this->evaluate_leaves_fmm<Order, Mixed_Precision>(curr_timestep);
+      break;
+    case PRECISION_KAHAN:
+      this->evaluate_leaves_fmm<Order, Kahan_Precision>(curr_timestep);
+      break;
+    case PRECISION_DOUBLE:
+      this->evaluate_leaves_fmm<Order, Double_Precision>(curr_timestep);
+      break;
+  }
+}
+
+template <int Order>
+void System::compute_expansions_fmm(int curr_timestep) {
+  // Update the size and occupancy of every layer
+  const float root_half_width = (this->base_block.x_max - this->base_block.x_min) / 2;
+  for (int layer = 0; layer <= this->tree_depth; layer++) {
+    FMM_Level& level = this->fmm_levels[layer];
+    level.half_width = root_half_width / level.cells_per_side;
+    for (int cell = 0; cell < level.num_cells; cell++) {
+      level.occupied[cell] = (layer == 0 || level.cells[cell]->num_elements > 0);
+    }
+  }
+
+  // Multipoles: P2M on the leaves, then M2M up to layer 2
+  this->upward_pass_fmm<Order>(curr_timestep);
+
+  // M2L for every layer that has an interaction list (layer 2 and below)
+  for (int layer = 2; layer <= this->tree_depth; layer++) {
+    FMM_Level& level = this->fmm_levels[layer];
+    std::fill(level.local.begin(), level.local.end(), 0.0f);
+    fmm_build_interaction_lists(this->fmm_operators, level);
+    fmm_m2l_batched<Order>(this->fmm_operators, level);
+  }
+
+  // Locals: L2L down to the leaves
+  this->downward_pass_fmm<Order>();
+}
+
+template <int Order>
+void System::upward_pass_fmm(int curr_timestep) {
+  constexpr int n = Order * Order * Order;
+
+  for (int layer = 2; layer <= this->tree_depth; layer++) {
+    std::fill(this->fmm_levels[layer].multipole.begin(), this->fmm_levels[layer].multipole.end(), 0.0f);
+  }
+
+  // P2M: anterpolate the masses of each leaf onto its nodes
+  // (leaves are independent, each thread takes a static share of them)
+  FMM_Level& leaves = this->fmm_levels[this->tree_depth];
+  const float inv_half_width = 1.0 / leaves.half_width;
+  #pragma omp parallel for schedule(static)
+  for (int cell = 0; cell < leaves.num_cells; cell++) {
+    if (!leaves.occupied[cell]) {
+      continue;
+    }
+    const Block* block = leaves.cells[cell];
+    float* multipole = &leaves.multipole[cell * n];
+    for (int element : block->element_idx) {
+      fmm_p2m<Order>((this->state.x[curr_timestep][element] - block->x_mid) * inv_half_width,
+                     (this->state.y[curr_timestep][element] - block->y_mid) * inv_half_width,
+                     (this->state.z[curr_timestep][element] - block->z_mid) * inv_half_width,
+                     this->state.mass[element], multipole);
+    }
+  }
+
+  // M2M: pass each child's multipole up to its parent
+  // (each thread takes a static share of the parents and gathers their
+  // children, so no two threads add to the same multipole)
+  for (int layer = this->tree_depth; layer > 2; layer--) {
+    FMM_Level& children = this->fmm_levels[layer];
+    FMM_Level& parents = this->fmm_levels[layer - 1];
+    const int side = parents.cells_per_side;
+    #pragma omp parallel for schedule(static)
+    for (int cell = 0; cell < parents.num_cells; cell++) {
+      if (!parents.occupied[cell]) {
+        continue;
+      }
+      const int ix = cell % side, iy = (cell / side) % side, iz = cell / (side * side);
+      float* parent_multipole = &parents.multipole[cell * n];
+      for (int child = 0; child < 8; child++) {
+        const int child_cell = children.cell_index(2 * ix + (child & 1), 2 * iy + ((child >> 1) & 1), 2 * iz + (child >> 2));
+        if (!children.occupied[child_cell]) {
+          continue;
+        }
+        fmm_m2m<Order>(children.cells[child_cell]->layer_idx, &children.multipole[child_cell * n], parent_multipole);
+      }
+    }
+  }
+}
+
+template <int Order>
+void System::downward_pass_fmm() {
+  constexpr int n = Order * Order * Order;
+
+  // L2L: interpolate each parent's local expansion onto its children
+  // (each child only writes its own local, so the cells of a layer are split
+  // between the threads)
+  for (int layer = 3; layer <= this->tree_depth; layer++) {
+    FMM_Level& children = this->fmm_levels[layer];
+    FMM_Level& parents = this->fmm_levels[layer - 1];
+    #pragma omp parallel for schedule(static)
+    for (int cell = 0; cell < children.num_cells; cell++) {
+      if (!children.occupied[cell]) {
+        continue;
+      }
+      const Block* block = children.cells[cell];
+      const float* parent_local = &parents.local[parents.cell_index(block->ix / 2, block->iy / 2, block->iz / 2) * n];
+      fmm_l2l<Order>(block->layer_idx, parent_local, &children.local[cell * n]);
+    }
+  }
+}
+
+template <int Order, typename Policy>
+void System::evaluate_leaves_fmm(int curr_timestep) {
+  typedef typename Policy::pair_t pair_t;
+  typedef typename Policy::accumulator_t accumulator_t;
+  constexpr int n = Order * Order * Order;
+  const double adjusted_constant = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR;
+
+  FMM_Level& leaves = this->fmm_levels[this->tree_depth];
+  const int side = leaves.cells_per_side;
+  const bool has_far_field = this->tree_depth >= 2;
+  const float inv_half_width = 1.0 / leaves.half_width;
+  const real_t* x = this->state.x[curr_timestep].data();
+  const real_t* y = this->state.y[curr_timestep].data();
+  const real_t* z = this->state.z[curr_timestep].data();
+  const real_t* mass = this->state.mass.data();
+
+  // Each thread takes a static share of the leaves
+  // (and only updates the velocities of their elements)
+  #pragma omp parallel for schedule(static)
+  for (int cell = 0; cell < leaves.num_cells; cell++) {
+    if (!leaves.occupied[cell]) {
+      continue;
+    }
+    const Block* block = leaves.cells[cell];
+    const float* local = &leaves.local[cell * n];
+
+    for (int element : block->element_idx) {
+      // The accumulated field is the gradient of sum(m / r)
+      accumulator_t field_x = 0, field_y = 0, field_z = 0;
+
+      // L2P: differentiate the interpolated local expansion
+      if (has_far_field) {
+        float far_x = 0, far_y = 0, far_z = 0;
+        fmm_l2p<Order>(local, (x[element] - block->x_mid) * inv_half_width,
+                              (y[element] - block->y_mid) * inv_half_width,
+                              (z[element] - block->z_mid) * inv_half_width, far_x, far_y, far_z);
+        field_x += far_x * inv_half_width;
+        field_y += far_y * inv_half_width;
+        field_z += far_z * inv_half_width;
+      }
+
+      // P2P: every element of this leaf and its neighbors
+      for (int jz = std::max(block->iz - 1, 0); jz <= std::min(block->iz + 1, side - 1); jz++) {
+        for (int jy = std::max(block->iy - 1, 0); jy <= std::min(block->iy + 1, side - 1); jy++) {
+          for (int jx = std::max(block->ix - 1, 0); jx <= std::min(block->ix + 1, side - 1); jx++) {
+            const int neighbor = leaves.cell_index(jx, jy, jz);
+            if (!leaves.occupied[neighbor]) {
+              continue;
+            }
+            const std::vector<int>& others = leaves.cells[neighbor]->element_idx;
+            fmm_p2p<Policy>(x, y, z, mass, others.data(), others.size(),
+                (pair_t) x[element], (pair_t) y[element], (pair_t) z[element], field_x, field_y, field_z);
+          }
+        }
+      }
+
+      // update element velocity
+      this->state.vx[curr_timestep][element] += adjusted_constant * static_cast<double>(field_x) * this->actual_delta_t;
+      this->state.vy[curr_timestep][element] += adjusted_constant * static_cast<double>(field_y) * this->actual_delta_t;
+      this->state.vz[curr_timestep][element] += adjusted_constant * static_cast<double>(field_z) * this->actual_delta_t;
+    }
+  }
+}
+
+double System::potential_energy_fmm(int curr_timestep) {
+  // Same passes as a time step, but the leaves evaluate the potential
+  // (sum(m / r)) instead of its gradient
+  if ((int) this->fmm_levels.size() != this->tree_depth + 1) {
+    this->initialize_fmm();
+  }
+  this->decompose_domain_fmm(curr_timestep);
+
+  // Dispatch to the kernels compiled for the expansion order
+  switch (this->fmm_operators.order) {
+    case 2:
+      return this->potential_energy_fmm_order<2>(curr_timestep);
+    case 3:
+      return this->potential_energy_fmm_order<3>(curr_timestep);
+    case 4:
+      return this->potential_energy_fmm_order<4>(curr_timestep);
+    case 5:
+      return this->potential_energy_fmm_order<5>(curr_timestep);
+    case 6:
+      return this->potential_energy_fmm_order<6>(curr_timestep);
+    case 7:
+      return this->potential_energy_fmm_order<7>(curr_timestep);
+    case 8:
+      return this->potential_energy_fmm_order<8>(curr_timestep);
+  }
+  return 0;
+}
+
+template <int Order>
+double System::potential_energy_fmm_order(int curr_timestep) {
+  constexpr int n = Order * Order * Order;
+  this->compute_expansions_fmm<Order>(curr_timestep);
+
+  FMM_Level& leaves = this->fmm_levels[this->tree_depth];
+  const int side = leaves.cells_per_side;
+  const float inv_half_width = 1.0 / leaves.half_width;
+  double potential_energy = 0;
+
+  for (int cell = 0; cell < leaves.num_cells; cell++) {
+    if (!leaves.occupied[cell]) {
+      continue;
+    }
+    const Block* block = leaves.cells[cell];
+    const float* local = &leaves.local[cell * n];
+
+    for (int element : block->element_idx) {
+      const float x = this->state.x[curr_timestep][element];
+      const float y = this->state.y[curr_timestep][element];
+      const float z = this->state.z[curr_timestep][element];
+      double potential = 0;
+
+      // L2P: interpolate the local expansion
+      if (this->tree_depth >= 2) {
+        potential += fmm_l2p_potential<Order>(local, (x - block->x_mid) * inv_half_width,
+                                                     (y - block->y_mid) * inv_half_width,
+                                                     (z - block->z_mid) * inv_half_width);
+      }
+
+      // P2P: every element of this leaf and its neighbors
+      for (int jz = std::max(block->iz - 1, 0); jz <= std::min(block->iz + 1, side - 1); jz++) {
+        for (int jy = std::max(block->iy - 1, 0); jy <= std::min(block->iy + 1, side - 1); jy++) {
+          for (int jx = std::max(block->ix - 1, 0); jx <= std::min(block->ix + 1, side - 1); jx++) {
+            const int neighbor = leaves.cell_index(jx, jy, jz);
+            if (!leaves.occupied[neighbor]) {
+              continue;
+            }
+            for (int other : leaves.cells[neighbor]->element_idx) {
+              const double dx = this->state.x[curr_timestep][other] - x;
+              const double dy = this->state.y[curr_timestep][other] - y;
+              const double dz = this->state.z[curr_timestep][other] - z;
+              const double r_squared = dx*dx + dy*dy + dz*dz;
+              if (r_squared == 0) {
+                continue;  // (includes the element itself)
+              }
+              potential += this->state.mass[other] / sqrt(r_squared);
+            }
+          }
+        }
+      }
+
+      potential_energy += this->state.mass[element] * potential;
+    }
+  }
+
+  // (every pair was counted twice)
+  const double adjusted_constant = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR;
+  return -0.5 * adjusted_constant * potential_energy;
+}
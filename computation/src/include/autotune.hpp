@@ -0,0 +1,39 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "declarations.hpp"
+#include "system.hpp"
+
+#include <string>
+
+// Settings picked by the auto-tuner for one kind of input on one machine
+struct Tuning_Profile {
+  Solver_Type solver = SOLVER_DIRECT;
+  int tree_depth = NUM_LAYERS;
+  int fmm_order = FMM_ORDER;
+  int pm_grid_size = PM_GRID_SIZE;
+  float pm_split_scale = PM_SPLIT_SCALE;
+  int direct_tile_size = DIRECT_TILE_SIZE;
+  int num_threads = 1;
+
+  // What the calibration measured for it
+  double step_time = 0;    // seconds per timestep
+  double force_error = 0;  // relative to the direct sum in double
+};
+
+// defined in autotune.cpp
+// Picks the fastest settings whose force error is within error_budget,
+// from short calibration steps on the initial conditions themselves
+// (setup costs are spread over num_time_steps).
+// The profile is cached in AUTOTUNE_PROFILE_FILE (per machine, size and
+// clustering of the input and budget) and reused unless use_cache is false.
+Tuning_Profile autotune_solver(float ic_data[][NUM_VALUES], const int num_elements, const int num_time_steps, const double error_budget, const bool use_cache);
+
+// defined in autotune.cpp
+// Sets the profile on the system (and the OpenMP thread count)
+void apply_tuning_profile(System& system, const Tuning_Profile& profile);
+
+// defined in autotune.cpp
+const char* solver_name(Solver_Type solver);
+
+#endif  // AUTOTUNE_H
@@ -1,6 +1,9 @@
 #ifndef DECLARATIONS_H
 #define DECLARATIONS_H
 
+#include <string>
+#include <vector>
+
 #define NUM_VALUES 7 // x, y, z, vx, vy, vz, mass
 #define GRAVITATIONAL_CONSTANT 6.67430e-11
 
@@ -9,7 +12,11 @@
 
 struct System;  // defined in system.hpp
 struct Block;   // defined in system.hpp
+struct Ensemble;  // defined in ensemble.hpp
 
-void output_results_HDF5(System system); // defined in output_results.cpp
+// (NUM_VALUES floats per element)
+std::vector<float> read_initial_conditions_HDF5(std::string input_filename); // defined in output_results.cpp
+void output_results_HDF5(System& system, std::string output_filename = "data/results.hdf5"); // defined in output_results.cpp
+void output_ensemble_HDF5(Ensemble& ensemble); // defined in output_results.cpp
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef DIRECT_KERNEL_H
+#define DIRECT_KERNEL_H
+
+#include "parameters.hpp"
+#include "precision.hpp"
+
+#include <algorithm> // for std::min
+#include <math.h> // for sqrt
+
+// Sums sum(m_j * (r_j - r) / |r_j - r|^3) over the elements [begin, end)
+// for one element at (x_1, y_1, z_1) (the caller multiplies by G).
+// Each tile of tile_size elements is summed (vectorized) in pair_t,
+// and only the per-tile partial sums go into the (more precise) accumulator.
+template <typename Policy>
+inline void direct_acceleration(
+    const typename Policy::pair_t* x, const typename Policy::pair_t* y, const typename Policy::pair_t* z,
+    const typename Policy::pair_t* mass, const int begin, const int end,
+    const typename Policy::pair_t x_1, const typename Policy::pair_t y_1, const typename Policy::pair_t z_1,
+    typename Policy::accumulator_t& accel_x, typename Policy::accumulator_t& accel_y, typename Policy::accumulator_t& accel_z,
+    const int tile_size = DIRECT_TILE_SIZE) {
+  typedef typename Policy::pair_t pair_t;
+
+  for (int tile_start = begin; tile_start < end; tile_start += tile_size) {
+    const int tile_end = std::min(tile_start + tile_size, end);
+    pair_t tile_x = 0, tile_y = 0, tile_z = 0;
+
+    #pragma omp simd reduction(+:tile_x, tile_y, tile_z)
+    for (int element_2 = tile_start; element_2 < tile_end; element_2++) {
+      const pair_t dx = x[element_2] - x_1;
+      const pair_t dy = y[element_2] - y_1;
+      const pair_t dz = z[element_2] - z_1;
+      const pair_t r_squared = dx*dx + dy*dy + dz*dz;
+      // (r_squared is only 0 for the element itself, which is skipped)
+      const pair_t inv_r = (r_squared > 0) ? 1 / sqrt(r_squared) : 0;
+      const pair_t weight = mass[element_2] * inv_r * inv_r * inv_r;
+      tile_x += weight * dx;
+      tile_y += weight * dy;
+      tile_z += weight * dz;
+    }
+
+    accel_x += tile_x;
+    accel_y += tile_y;
+    accel_z += tile_z;
+  }
+}
+
+#endif  // DIRECT_KERNEL_H
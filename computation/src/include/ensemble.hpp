@@ -0,0 +1,58 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "parameters.hpp"
+#include "declarations.hpp"
+#include "precision.hpp"
+
+#include <vector>
+#include <string>
+
+
+// The ensemble sums its (small) systems in the storage type,
+// with double accumulation
+struct Ensemble_Precision {
+  typedef real_t pair_t;
+  typedef double accumulator_t;
+};
+
+
+// Many small independent systems solved together in one process.
+// All the systems are packed into one SoA layout: system s owns the
+// elements [offsets[s], offsets[s + 1]) of every array.
+struct Ensemble {
+  int num_systems;
+  int num_time_steps;
+  int total_elements;
+  int max_elements;  // of any one system
+  float delta_t;
+  float actual_delta_t;
+
+  std::vector<std::string> names;  // (HDF5 group of each system)
+  std::vector<int> offsets;
+
+  // Current state of every element
+  std::vector<real_t> x, y, z;
+  std::vector<real_t> vx, vy, vz;
+  std::vector<real_t> mass;
+
+  // Position of every element at each time step, [timestep][element]
+  std::vector<std::vector<real_t>> x_history;
+  std::vector<std::vector<real_t>> y_history;
+  std::vector<std::vector<real_t>> z_history;
+
+  // Constructor
+  // (ic_data[s] holds the initial conditions of system s, NUM_VALUES per element)
+  Ensemble(const std::vector<std::vector<float>>& ic_data, const std::vector<std::string>& names, const int num_time_steps, const float delta_t);
+
+  int num_elements(int system) const { return this->offsets[system + 1] - this->offsets[system]; }
+
+  // Solves every system (in parallel across systems)
+  void solve();
+
+  // Solves every timestep of one system
+  // (accel_* are scratch arrays of at least max_elements)
+  void solve_system(int system, double* accel_x, double* accel_y, double* accel_z);
+};
+
+#endif  // ENSEMBLE_H
@@ -0,0 +1,31 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <vector>
+
+// In-tree FFT (radix-2), used by the particle-mesh solver.
+// Sizes must be powers of 2, and the transforms are unnormalized
+// (an inverse after a forward transform multiplies by the size).
+
+// defined in fft.cpp
+void fft_1d(std::complex<float>* data, int n, bool inverse);
+
+// Real transforms of a zero padded grid: data is an extent^3 real grid
+// (indexed by x + extent * (y + extent * z)) standing for the corner of an
+// n^3 grid that is zero everywhere else.
+// The spectrum of a real grid is Hermitian, so only its half with
+// kx <= n / 2 is kept: (n / 2 + 1) x n x n values, indexed by
+// kx + (n / 2 + 1) * (ky + n * kz).
+// Two real lines are transformed as one complex line, and the lines that
+// only hold padding are skipped, so a transform costs about a quarter of
+// a complex 3D transform of the padded grid.
+
+// defined in fft.cpp
+void fft_3d_real_forward(const std::vector<float>& data, int n, int extent, std::vector<std::complex<float>>& spectrum);
+
+// defined in fft.cpp
+// (only the extent^3 corner is computed, the spectrum is overwritten)
+void fft_3d_real_inverse(std::vector<std::complex<float>>& spectrum, int n, int extent, std::vector<float>& data);
+
+#endif  // FFT_H
@@ -0,0 +1,93 @@
+#ifndef FMM_H
+#define FMM_H
+
+#include "declarations.hpp"
+#include "numa.hpp"
+
+#include <vector>
+
+// The FMM uses Chebyshev interpolation ("black-box" FMM) for its expansions.
+// Every cell holds one weight per Chebyshev node (order^3 of them), so every
+// translation operator is just a small dense matrix.
+// Nodes are indexed as: node = kx + order * (ky + order * kz)
+
+// Orders with compiled kernels (see fmm_kernels.hpp)
+#define FMM_MIN_ORDER 2
+#define FMM_MAX_ORDER 8
+
+// Tree depths the Python setter accepts (the leaves must be below the base
+// block, which holds no elements, and 8 layers are already 2^24 leaves)
+#define FMM_MIN_DEPTH 1
+#define FMM_MAX_DEPTH 8
+
+// Offsets (in cells) covered by the M2L operator tables
+#define M2L_MAX_OFFSET 3
+#define M2L_OFFSET_RANGE (2 * M2L_MAX_OFFSET + 1)
+
+// Number of target/source pairs pushed through one M2L operator at once
+#define M2L_PAIR_BLOCK 4
+
+
+// Translation operators, precomputed once and shared by every level.
+// (The 1/r kernel is scale invariant, so the operators are built for a
+// unit cell and scaled by 1/half_width when applied.)
+struct FMM_Operators {
+  int order = 0;      // Chebyshev nodes per dimension
+  int num_nodes = 0;  // Chebyshev nodes per cell (order^3)
+
+  // 1D Chebyshev nodes on [-1, 1]
+  // (M2M and L2L are separable, their 1D tables are in fmm_kernels.hpp)
+  std::vector<float> nodes;
+
+  // M2L operators, one per relative offset in the interaction list
+  // m2l[offset][source_node * num_nodes + target_node]
+  std::vector<int> m2l_offsets;  // (dx, dy, dz) of each operator
+  std::vector<std::vector<float>> m2l;
+  int m2l_index[M2L_OFFSET_RANGE][M2L_OFFSET_RANGE][M2L_OFFSET_RANGE];  // -1 if not well separated
+
+  FMM_Operators() {}
+
+  // Constructor (defined in fmm_kernels.cpp)
+  FMM_Operators(int order);
+};
+
+
+// Flattened view of one layer of the Block tree, used by the FMM passes
+struct FMM_Level {
+  int layer;
+  int cells_per_side;
+  int num_cells;
+  float half_width;  // re-set every time step
+
+  // Blocks of this layer indexed by cell = ix + cells_per_side * (iy + cells_per_side * iz)
+  std::vector<Block*> cells;
+  std::vector<char> occupied;
+
+  // Expansion weights, [cell * num_nodes + node]
+  // (placed for the static partition over cells, see numa.hpp)
+  numa_vector<float> multipole;
+  numa_vector<float> local;
+
+  // Interaction list grouped by offset (rebuilt every time step)
+  // m2l_targets[offset][pair], m2l_sources[offset][pair], in target order
+  std::vector<std::vector<int>> m2l_targets;
+  std::vector<std::vector<int>> m2l_sources;
+
+  FMM_Level(int layer, int num_nodes);
+
+  int cell_index(int ix, int iy, int iz) const {
+    return ix + this->cells_per_side * (iy + this->cells_per_side * iz);
+  }
+};
+
+
+// defined in fmm_kernels.cpp
+void fmm_build_interaction_lists(const FMM_Operators& operators, FMM_Level& level);
+
+// defined in fmm_kernels.cpp
+// Accumulates the M2L contributions of every interaction list of the level
+// into level.local, one dense batched product per offset.
+// (dispatches to the kernel compiled for operators.order)
+void fmm_m2l_batched(const FMM_Operators& operators, FMM_Level& level);
+
+#endif  // FMM_H
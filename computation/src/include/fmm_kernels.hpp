@@ -0,0 +1,384 @@
+#ifndef FMM_KERNELS_H
+#define FMM_KERNELS_H
+
+#include "fmm.hpp"
+#include "precision.hpp"
+
+#include <math.h> // for sqrt
+#include <algorithm> // for std::lower_bound
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// FMM kernels specialised on the expansion order (and the precision policy,
+// see precision.hpp). With the order known at compile time every loop over
+// the Chebyshev nodes has a fixed trip count, so the compiler unrolls and
+// vectorizes them, and the coefficient tables below are built by the compiler.
+// The solver picks the instantiation for the run time order with a switch
+// over FMM_MIN_ORDER..FMM_MAX_ORDER (see fmm_solver.cpp).
+
+
+// cos(x) for 0 <= x <= pi, usable in constant expressions
+// (Taylor series around pi/2, converged to double precision)
+constexpr double constexpr_cos(double x) {
+  const double h = x - M_PI / 2;  // cos(x) = -sin(x - pi/2)
+  double term = h, sum = 0;
+  for (int m = 1; m < 40; m += 2) {
+    sum += term;
+    term *= -h * h / ((m + 1) * (m + 2));
+  }
+  return -sum;
+}
+
+
+// Chebyshev coefficient tables of one order
+template <int Order>
+struct Chebyshev_Table {
+  static_assert(Order >= FMM_MIN_ORDER && Order <= FMM_MAX_ORDER, "no kernels for this order");
+
+  // 1D Chebyshev nodes (of the first kind) on [-1, 1]
+  float nodes[Order] = {};
+
+  // S(u, t_k) = sum_m coefficients[k][m] T_m(u)
+  //           = 1/p + 2/p * sum_{m=1}^{p-1} T_m(t_k) T_m(u)
+  float coefficients[Order][Order] = {};
+
+  // 1D child to parent interpolation, shift[half][parent_node][child_node]
+  // (half 0 is the lower child, centered at -0.5 in parent coordinates)
+  float shift[2][Order][Order] = {};
+
+  constexpr Chebyshev_Table() {
+    for (int k = 0; k < Order; k++) {
+      this->nodes[k] = constexpr_cos(M_PI * (2 * k + 1) / (2.0 * Order));
+    }
+    for (int k = 0; k < Order; k++) {
+      double T_prev = 1, T = this->nodes[k];  // T_0(t_k), T_1(t_k)
+      this->coefficients[k][0] = 1.0 / Order;
+      for (int m = 1; m < Order; m++) {
+        this->coefficients[k][m] = 2 * T / Order;
+        const double T_next = 2 * this->nodes[k] * T - T_prev;
+        T_prev = T;
+        T = T_next;
+      }
+    }
+    for (int half = 0; half < 2; half++) {
+      for (int j = 0; j < Order; j++) {
+        const double u = 0.5 * this->nodes[j] + (half ? 0.5 : -0.5);
+        double T_prev = 1, T = u;  // T_0(u), T_1(u)
+        double T_u[Order] = {};
+        for (int m = 0; m < Order; m++) {
+          T_u[m] = T_prev;
+          const double T_next = 2 * u * T - T_prev;
+          T_prev = T;
+          T = T_next;
+        }
+        for (int k = 0; k < Order; k++) {
+          double weight = 0;
+          for (int m = 0; m < Order; m++) {
+            weight += this->coefficients[k][m] * T_u[m];
+          }
+          this->shift[half][k][j] = weight;
+        }
+      }
+    }
+  }
+};
+
+template <int Order>
+constexpr Chebyshev_Table<Order> chebyshev_table{};
+
+
+// Interpolation weights of the point u (in [-1, 1]) for each 1D node
+template <int Order>
+inline void chebyshev_weights(const float u, float* weights) {
+  const Chebyshev_Table<Order>& table = chebyshev_table<Order>;
+  float T[Order];
+  T[0] = 1;
+  for (int m = 1; m < Order; m++) {
+    T[m] = (m == 1) ? u : 2 * u * T[m - 1] - T[m - 2];
+  }
+  for (int k = 0; k < Order; k++) {
+    float weight = 0;
+    for (int m = 0; m < Order; m++) {
+      weight += table.coefficients[k][m] * T[m];
+    }
+    weights[k] = weight;
+  }
+}
+
+// Same as above, but also returns d(weights)/du
+// (d/du T_m(u) = m U_{m-1}(u))
+template <int Order>
+inline void chebyshev_weights_derivative(const float u, float* weights, float* derivatives) {
+  const Chebyshev_Table<Order>& table = chebyshev_table<Order>;
+  float T[Order], dT[Order];
+  float U_prev = 0, U = 1;  // U_{-1}(u), U_0(u)
+  T[0] = 1;
+  dT[0] = 0;
+  for (int m = 1; m < Order; m++) {
+    T[m] = (m == 1) ? u : 2 * u * T[m - 1] - T[m - 2];
+    dT[m] = m * U;
+    const float U_next = 2 * u * U - U_prev;
+    U_prev = U;
+    U = U_next;
+  }
+  for (int k = 0; k < Order; k++) {
+    float weight = 0, derivative = 0;
+    for (int m = 0; m < Order; m++) {
+      weight += table.coefficients[k][m] * T[m];
+      derivative += table.coefficients[k][m] * dT[m];
+    }
+    weights[k] = weight;
+    derivatives[k] = derivative;
+  }
+}
+
+
+// P2M: anterpolate one element (at u_x, u_y, u_z in leaf coordinates) onto the leaf nodes
+template <int Order>
+inline void fmm_p2m(const float u_x, const float u_y, const float u_z, const float mass, float* multipole) {
+  float sx[Order], sy[Order], sz[Order];
+  chebyshev_weights<Order>(u_x, sx);
+  chebyshev_weights<Order>(u_y, sy);
+  chebyshev_weights<Order>(u_z, sz);
+  for (int kz = 0; kz < Order; kz++) {
+    for (int ky = 0; ky < Order; ky++) {
+      const float weight_yz = mass * sy[ky] * sz[kz];
+      for (int kx = 0; kx < Order; kx++) {
+        multipole[kx + Order * (ky + Order * kz)] += weight_yz * sx[kx];
+      }
+    }
+  }
+}
+
+// M2M: add a child's multipole (child = its layer_idx) to its parent's.
+// The interpolation is a product of 1D ones, so it is applied one
+// dimension at a time (p^4 operations instead of p^6).
+template <int Order>
+inline void fmm_m2m(const int child, const float* child_multipole, float* parent_multipole) {
+  const Chebyshev_Table<Order>& table = chebyshev_table<Order>;
+  const float (&shift_x)[Order][Order] = table.shift[child & 1];
+  const float (&shift_y)[Order][Order] = table.shift[(child >> 1) & 1];
+  const float (&shift_z)[Order][Order] = table.shift[(child >> 2) & 1];
+  float along_x[Order * Order * Order], along_y[Order * Order * Order];
+
+  // [kx + p * (jy + p * jz)]
+  for (int jz = 0; jz < Order; jz++) {
+    for (int jy = 0; jy < Order; jy++) {
+      const float* row = &child_multipole[Order * (jy + Order * jz)];
+      for (int kx = 0; kx < Order; kx++) {
+        float sum = 0;
+        for (int jx = 0; jx < Order; jx++) {
+          sum += shift_x[kx][jx] * row[jx];
+        }
+        along_x[kx + Order * (jy + Order * jz)] = sum;
+      }
+    }
+  }
+  // [kx + p * (ky + p * jz)]
+  for (int jz = 0; jz < Order; jz++) {
+    for (int ky = 0; ky < Order; ky++) {
+      for (int kx = 0; kx < Order; kx++) {
+        float sum = 0;
+        for (int jy = 0; jy < Order; jy++) {
+          sum += shift_y[ky][jy] * along_x[kx + Order * (jy + Order * jz)];
+        }
+        along_y[kx + Order * (ky + Order * jz)] = sum;
+      }
+    }
+  }
+  for (int kz = 0; kz < Order; kz++) {
+    for (int ky = 0; ky < Order; ky++) {
+      for (int kx = 0; kx < Order; kx++) {
+        float sum = 0;
+        for (int jz = 0; jz < Order; jz++) {
+          sum += shift_z[kz][jz] * along_y[kx + Order * (ky + Order * jz)];
+        }
+        parent_multipole[kx + Order * (ky + Order * kz)] += sum;
+      }
+    }
+  }
+}
+
+// L2L: add the parent's local expansion to a child's (the transpose of M2M)
+template <int Order>
+inline void fmm_l2l(const int child, const float* parent_local, float* child_local) {
+  const Chebyshev_Table<Order>& table = chebyshev_table<Order>;
+  const float (&shift_x)[Order][Order] = table.shift[child & 1];
+  const float (&shift_y)[Order][Order] = table.shift[(child >> 1) & 1];
+  const float (&shift_z)[Order][Order] = table.shift[(child >> 2) & 1];
+  float along_x[Order * Order * Order], along_y[Order * Order * Order];
+
+  // [jx + p * (ky + p * kz)]
+  for (int kz = 0; kz < Order; kz++) {
+    for (int ky = 0; ky < Order; ky++) {
+      const float* row = &parent_local[Order * (ky + Order * kz)];
+      for (int jx = 0; jx < Order; jx++) {
+        float sum = 0;
+        for (int kx = 0; kx < Order; kx++) {
+          sum += shift_x[kx][jx] * row[kx];
+        }
+        along_x[jx + Order * (ky + Order * kz)] = sum;
+      }
+    }
+  }
+  // [jx + p * (jy + p * kz)]
+  for (int kz = 0; kz < Order; kz++) {
+    for (int jy = 0; jy < Order; jy++) {
+      for (int jx = 0; jx < Order; jx++) {
+        float sum = 0;
+        for (int ky = 0; ky < Order; ky++) {
+          sum += shift_y[ky][jy] * along_x[jx + Order * (ky + Order * kz)];
+        }
+        along_y[jx + Order * (jy + Order * kz)] = sum;
+      }
+    }
+  }
+  for (int jz = 0; jz < Order; jz++) {
+    for (int jy = 0; jy < Order; jy++) {
+      for (int jx = 0; jx < Order; jx++) {
+        float sum = 0;
+        for (int kz = 0; kz < Order; kz++) {
+          sum += shift_z[kz][jz] * along_y[jx + Order * (jy + Order * kz)];
+        }
+        child_local[jx + Order * (jy + Order * jz)] += sum;
+      }
+    }
+  }
+}
+
+// L2P: gradient of the local expansion at (u_x, u_y, u_z) in leaf coordinates
+// (per unit u, the caller divides by the half width)
+template <int Order>
+inline void fmm_l2p(const float* local, const float u_x, const float u_y, const float u_z,
+    float& field_x, float& field_y, float& field_z) {
+  float sx[Order], sy[Order], sz[Order], dsx[Order], dsy[Order], dsz[Order];
+  chebyshev_weights_derivative<Order>(u_x, sx, dsx);
+  chebyshev_weights_derivative<Order>(u_y, sy, dsy);
+  chebyshev_weights_derivative<Order>(u_z, sz, dsz);
+  for (int kz = 0; kz < Order; kz++) {
+    for (int ky = 0; ky < Order; ky++) {
+      for (int kx = 0; kx < Order; kx++) {
+        const float weight = local[kx + Order * (ky + Order * kz)];
+        field_x += weight * dsx[kx] * sy[ky] * sz[kz];
+        field_y += weight * sx[kx] * dsy[ky] * sz[kz];
+        field_z += weight * sx[kx] * sy[ky] * dsz[kz];
+      }
+    }
+  }
+}
+
+// L2P for the potential: the local expansion interpolated at (u_x, u_y, u_z)
+template <int Order>
+inline double fmm_l2p_potential(const float* local, const float u_x, const float u_y, const float u_z) {
+  float sx[Order], sy[Order], sz[Order];
+  chebyshev_weights<Order>(u_x, sx);
+  chebyshev_weights<Order>(u_y, sy);
+  chebyshev_weights<Order>(u_z, sz);
+  double potential = 0;
+  for (int kz = 0; kz < Order; kz++) {
+    for (int ky = 0; ky < Order; ky++) {
+      for (int kx = 0; kx < Order; kx++) {
+        potential += local[kx + Order * (ky + Order * kz)] * sx[kx] * sy[ky] * sz[kz];
+      }
+    }
+  }
+  return potential;
+}
+
+
+// P2P: sums sum(m_j * (r_j - r) / |r_j - r|^3) over the listed elements
+// for one element at (x_1, y_1, z_1), like direct_acceleration
+// (one leaf is one tile: summed in pair_t, then added to the accumulator)
+template <typename Policy>
+inline void fmm_p2p(const real_t* x, const real_t* y, const real_t* z, const real_t* mass,
+    const int* elements, const int count,
+    const typename Policy::pair_t x_1, const typename Policy::pair_t y_1, const typename Policy::pair_t z_1,
+    typename Policy::accumulator_t& accel_x, typename Policy::accumulator_t& accel_y, typename Policy::accumulator_t& accel_z) {
+  typedef typename Policy::pair_t pair_t;
+  pair_t tile_x = 0, tile_y = 0, tile_z = 0;
+
+  #pragma omp simd reduction(+:tile_x, tile_y, tile_z)
+  for (int i = 0; i < count; i++) {
+    const int element_2 = elements[i];
+    const pair_t dx = x[element_2] - x_1;
+    const pair_t dy = y[element_2] - y_1;
+    const pair_t dz = z[element_2] - z_1;
+    const pair_t r_squared = dx*dx + dy*dy + dz*dz;
+    // (r_squared is only 0 for the element itself, which is skipped)
+    const pair_t inv_r = (r_squared > 0) ? 1 / sqrt(r_squared) : 0;
+    const pair_t weight = mass[element_2] * inv_r * inv_r * inv_r;
+    tile_x += weight * dx;
+    tile_y += weight * dy;
+    tile_z += weight * dz;
+  }
+
+  accel_x += tile_x;
+  accel_y += tile_y;
+  accel_z += tile_z;
+}
+
+
+// M2L for every interaction list of the level (see fmm_m2l_batched in fmm.hpp)
+template <int Order>
+void fmm_m2l_batched(const FMM_Operators& operators, FMM_Level& level) {
+  constexpr int n = Order * Order * Order;
+  const float scale = 1.0 / level.half_width;  // operators are for a unit cell
+
+  // Each thread owns a contiguous range of target cells (the same static
+  // partition the locals were placed with, see numa.hpp) and only applies
+  // the pairs of its targets, so no two threads write the same local.
+  // (the pairs of each offset are sorted by target, see fmm_build_interaction_lists)
+  #pragma omp parallel
+  {
+    int thread = 0, num_threads = 1;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+    num_threads = omp_get_num_threads();
+#endif
+    const int first_cell = (long) level.num_cells * thread / num_threads;
+    const int last_cell = (long) level.num_cells * (thread + 1) / num_threads;
+    float accumulator[M2L_PAIR_BLOCK * n];
+
+    // Every pair sharing an offset uses the same operator, so each offset
+    // becomes one (num_pairs x n) * (n x n) product. Pairs are processed
+    // M2L_PAIR_BLOCK at a time so every operator row is reused from cache.
+    for (int offset = 0; offset < (int) operators.m2l.size(); offset++) {
+      const float* op = operators.m2l[offset].data();
+      const std::vector<int>& targets = level.m2l_targets[offset];
+      const std::vector<int>& sources = level.m2l_sources[offset];
+      const int first_pair = std::lower_bound(targets.begin(), targets.end(), first_cell) - targets.begin();
+      const int last_pair = std::lower_bound(targets.begin(), targets.end(), last_cell) - targets.begin();
+
+      for (int first = first_pair; first < last_pair; first += M2L_PAIR_BLOCK) {
+        const int count = (last_pair - first < M2L_PAIR_BLOCK) ? last_pair - first : M2L_PAIR_BLOCK;
+        for (int a = 0; a < M2L_PAIR_BLOCK * n; a++) {
+          accumulator[a] = 0;
+        }
+
+        for (int b = 0; b < n; b++) {
+          const float* op_row = op + b * n;
+          for (int pair = 0; pair < count; pair++) {
+            const float weight = level.multipole[sources[first + pair] * n + b];
+            float* acc = &accumulator[pair * n];
+            #pragma omp simd
+            for (int a = 0; a < n; a++) {
+              acc[a] += weight * op_row[a];
+            }
+          }
+        }
+
+        for (int pair = 0; pair < count; pair++) {
+          float* local = &level.local[targets[first + pair] * n];
+          const float* acc = &accumulator[pair * n];
+          #pragma omp simd
+          for (int a = 0; a < n; a++) {
+            local[a] += scale * acc[a];
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif  // FMM_KERNELS_H
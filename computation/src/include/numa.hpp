@@ -0,0 +1,72 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stddef.h>
+#include <vector>
+
+// NUMA placement of the large arrays (state and tree buffers).
+// Linux places a page on the node of the thread that first writes it, so
+// the arrays are touched in parallel with the same static partition the
+// compute loops use ("omp parallel for schedule(static)" over elements or
+// cells), and each thread then mostly reads and writes local memory.
+
+// How the OpenMP threads are pinned to cpus
+enum Thread_Pinning {
+  PIN_NONE,     // left to the OS (or to OMP_PROC_BIND / OMP_PLACES)
+  PIN_COMPACT,  // fill the cpus of one node before moving to the next
+  PIN_SPREAD    // round robin over the nodes
+};
+
+struct Numa_Settings {
+  Thread_Pinning pinning;
+  bool first_touch;  // touch new arrays in parallel (else they are left to the first writer)
+  bool huge_pages;   // ask for transparent huge pages on the large arrays
+};
+
+// defined in numa.cpp (initialized from parameters.hpp)
+extern Numa_Settings numa_settings;
+
+// defined in numa.cpp
+// Pins every thread of the OpenMP pool (call before allocating the state)
+void pin_threads(Thread_Pinning pinning);
+
+// defined in numa.cpp
+int numa_num_nodes();
+
+// defined in numa.cpp
+const char* pinning_name(Thread_Pinning pinning);
+
+// defined in numa.cpp
+// Allocates bytes placed as described above, and releases them
+void* numa_allocate(size_t bytes);
+void numa_deallocate(void* pointer, size_t bytes);
+
+
+// Allocator of the state and tree arrays
+template <typename T>
+struct Numa_Allocator {
+  typedef T value_type;
+
+  Numa_Allocator() {}
+  template <typename U>
+  Numa_Allocator(const Numa_Allocator<U>&) {}
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(numa_allocate(count * sizeof(T)));
+  }
+
+  void deallocate(T* pointer, size_t count) {
+    numa_deallocate(pointer, count * sizeof(T));
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const Numa_Allocator<T>&, const Numa_Allocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const Numa_Allocator<T>&, const Numa_Allocator<U>&) { return false; }
+
+template <typename T>
+using numa_vector = std::vector<T, Numa_Allocator<T>>;
+
+#endif  // NUMA_H
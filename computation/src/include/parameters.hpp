@@ -3,6 +3,75 @@
 
 #define DEFAULT_MASS 1.0
 
+// Precision policy of the direct solver (see precision.hpp)
+#define DEFAULT_PRECISION_POLICY PRECISION_MIXED
+
+// Number of elements the direct solver sums in the pair precision
+// before adding the partial force to the accumulator
+#define DIRECT_TILE_SIZE 256
+
+// Timesteps between diagnostic records (0 disables the diagnostics)
+#define DIAGNOSTIC_INTERVAL 10
+
+// Above this many elements the potential energy is computed with the FMM
+// instead of summing every pair
+#define DIAGNOSTIC_DIRECT_LIMIT 4096
+
+// Relative energy drift above which the diagnostics print a warning
+#define DIAGNOSTIC_DRIFT_WARNING 1e-2
+
+// What the solver writes (OUTPUT_FULL or OUTPUT_REDUCED, see system.hpp)
+#define DEFAULT_OUTPUT_MODE OUTPUT_FULL
+
+// Reduced output: timesteps between records, pixels per side of the
+// projected density images, cells per side of the 3D grid (0 for none)
+// and number of tracers sampled when none are given
+#define REDUCTION_INTERVAL 5
+#define REDUCTION_IMAGE_SIZE 256
+#define REDUCTION_GRID_SIZE 32
+#define REDUCTION_NUM_TRACERS 1000
+
+// Reduced output: size of the imaged region relative to the initial
+// bounding box (leaves room for the system to expand)
+#define REDUCTION_EXTENT_SCALE 1.5
+
+// Chebyshev nodes per dimension used by the FMM expansions
+// (2 to 8, the orders with compiled kernels, see fmm.hpp)
+#define FMM_ORDER 4
+
+// PM solver: nodes per dimension of the mesh (rounded up to a power of 2)
+#define PM_GRID_SIZE 64
+
+// PM solver: mass assignment (0 for CIC, 1 for TSC)
+#define PM_USE_TSC 0
+
+// PM solver: add the short-range correction between leaves (P3M)
+#define PM_SHORT_RANGE 1
+
+// PM solver: scale r_s of the long/short-range split (in grid spacings)
+// and the short-range cutoff (in units of r_s)
+#define PM_SPLIT_SCALE 1.25
+#define PM_CUTOFF 4.5
+
+// Auto-tuner: default force error budget (relative to the direct sum),
+// elements sampled for the reference forces, largest system the direct
+// solver is calibrated on (bigger ones are extrapolated as N^2) and the
+// file the chosen profiles are cached in
+#define AUTOTUNE_ERROR_BUDGET 1e-3
+#define AUTOTUNE_SAMPLE_SIZE 256
+#define AUTOTUNE_DIRECT_LIMIT 8192
+#define AUTOTUNE_PROFILE_FILE "data/autotune_profiles.txt"
+
+// Thread pinning (PIN_NONE, PIN_COMPACT or PIN_SPREAD, see numa.hpp)
+#define NUMA_THREAD_PINNING PIN_NONE
+
+// Touch the state and tree arrays in parallel when they are allocated
+// (so their pages are spread over the NUMA nodes like the threads)
+#define NUMA_FIRST_TOUCH 1
+
+// Back the large arrays with transparent huge pages
+#define NUMA_HUGE_PAGES 0
+
 // Scaling Factors
 // Makes 1.0 distance equal to (1 AU)
 // Makes 1.0 time equal to (1 day)
@@ -0,0 +1,59 @@
+#ifndef PM_H
+#define PM_H
+
+#include <complex>
+#include <vector>
+
+// Empty nodes between the domain and the edge of the grid
+// (room for the TSC assignment and the 4-point gradient)
+#define PM_MARGIN 3
+
+// z planes per slab of the parallel mass assignment. Slabs two apart never
+// touch the same nodes (an element reaches at most 2 planes past its slab),
+// so the even slabs are filled in parallel, then the odd ones.
+#define PM_SLAB_WIDTH 4
+
+
+// Mesh of the particle-mesh (PM/P3M) solver.
+// The force is split with a Gaussian of scale r_s: the mesh solves the
+// long-range part (kernel erf(r / 2r_s) / r) and the short-range
+// remainder is summed directly between neighboring leaves.
+struct PM_Grid {
+  int size = 0;           // nodes per dimension covering the domain
+  int padded_size = 0;    // 2 * size (zero padding for isolated boundaries)
+  float split_scale = 0;  // r_s, in grid spacings
+
+  // re-set every time step
+  float spacing = 0;
+  float origin_x = 0, origin_y = 0, origin_z = 0;  // position of node 0
+
+  // Mass at each node (size^3, the padding is implicit, see fft.hpp)
+  std::vector<float> density;
+
+  // Half spectrum of the padded density (see fft.hpp)
+  std::vector<std::complex<float>> spectrum;
+
+  // FFT of the long-range kernel on the padded grid, in grid units
+  // (real, as the kernel is real and even, and scale invariant, so it is
+  // only built once), same layout as the spectrum
+  std::vector<float> green;
+
+  // Elements of each slab of PM_SLAB_WIDTH z planes (re-set every time step),
+  // slab_elements[slab_start[slab] .. slab_start[slab + 1]]
+  std::vector<int> slab_start;
+  std::vector<int> slab_elements;
+
+  // sum(m * long-range kernel) at each node (size^3)
+  std::vector<float> potential;
+
+  PM_Grid() {}
+
+  // Constructor (defined in pm_solver.cpp)
+  PM_Grid(int size, float split_scale);
+
+  int node_index(int ix, int iy, int iz) const {
+    return ix + this->size * (iy + this->size * iz);
+  }
+};
+
+#endif  // PM_H
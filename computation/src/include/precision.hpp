@@ -0,0 +1,73 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+// Storage type of the state (positions, velocities, masses).
+// Configure with -DSOLVER_DOUBLE_PRECISION=ON for a full double build.
+#ifdef SOLVER_DOUBLE_PRECISION
+typedef double real_t;
+#else
+typedef float real_t;
+#endif
+
+
+// Compensated (Kahan) sum, for accumulating in float without the drift
+struct Kahan_Sum {
+  float sum = 0;
+  float compensation = 0;
+
+  Kahan_Sum() {}
+  Kahan_Sum(float value) : sum(value) {}
+
+  Kahan_Sum& operator+=(float value) {
+    const float y = value - this->compensation;
+    const float t = this->sum + y;
+    this->compensation = (t - this->sum) - y;
+    this->sum = t;
+    return *this;
+  }
+
+  operator float() const { return this->sum; }
+};
+
+
+// Precision policies for the force evaluation.
+// pair_t is used for the pair kernel (the vectorized inner loop),
+// accumulator_t to sum the per-tile partial forces of each element.
+
+// Everything in float (the original behaviour)
+struct Float_Precision {
+  typedef float pair_t;
+  typedef float accumulator_t;
+  static constexpr const char* name = "float";
+};
+
+// Float pair kernel, double accumulation
+struct Mixed_Precision {
+  typedef float pair_t;
+  typedef double accumulator_t;
+  static constexpr const char* name = "mixed";
+};
+
+// Float pair kernel, Kahan-compensated float accumulation
+struct Kahan_Precision {
+  typedef float pair_t;
+  typedef Kahan_Sum accumulator_t;
+  static constexpr const char* name = "kahan";
+};
+
+// Everything in double
+struct Double_Precision {
+  typedef double pair_t;
+  typedef double accumulator_t;
+  static constexpr const char* name = "double";
+};
+
+// Runtime selection of the policies above
+enum Precision_Policy {
+  PRECISION_FLOAT,
+  PRECISION_MIXED,
+  PRECISION_KAHAN,
+  PRECISION_DOUBLE
+};
+
+#endif  // PRECISION_H
@@ -3,48 +3,141 @@
 
 #include "parameters.hpp"
 #include "declarations.hpp"
+#include "precision.hpp"
+#include "fmm.hpp"
+#include "pm.hpp"
+#include "numa.hpp"
 
 #include <vector>
+#include <algorithm> // for std::max
+#include <math.h> // for fabs
 
 
+// Arrays of one state variable, indexed [timestep][element].
+// Only the latest num_slots timesteps are kept, timestep t in slot
+// t % num_slots: a step only reads the previous timestep, so 2 slots are
+// enough unless every timestep is written out (OUTPUT_FULL).
+struct State_History {
+  std::vector<numa_vector<real_t>> slots;
+
+  void resize(int num_slots, int num_elements) {
+    this->slots.resize(num_slots);
+    for (int i = 0; i < num_slots; i++) {
+      this->slots[i].resize(num_elements);
+    }
+  }
+
+  numa_vector<real_t>& operator[](int timestep) {
+    return this->slots[timestep % (int) this->slots.size()];
+  }
+
+  const numa_vector<real_t>& operator[](int timestep) const {
+    return this->slots[timestep % (int) this->slots.size()];
+  }
+};
+
 // Holds the state of the system at each time step
+// (every array is placed for the static partition over elements, see numa.hpp)
 struct State_Data {
+  int num_slots;  // timesteps kept (num_time_steps, or 2 for the reduced output)
 
   // Position
-  std::vector<std::vector<float>> x;
-  std::vector<std::vector<float>> y;
-  std::vector<std::vector<float>> z;
+  State_History x;
+  State_History y;
+  State_History z;
 
   // Velocity
-  std::vector<std::vector<float>> vx;
-  std::vector<std::vector<float>> vy;
-  std::vector<std::vector<float>> vz;
+  State_History vx;
+  State_History vy;
+  State_History vz;
 
   // Mass
-  std::vector<float> mass;
+  numa_vector<real_t> mass;
 
   // Constructor
-  State_Data(int num_time_steps, int num_elements) {
-    x.resize(num_time_steps);
-    y.resize(num_time_steps);
-    z.resize(num_time_steps);
-    vx.resize(num_time_steps);
-    vy.resize(num_time_steps);
-    vz.resize(num_time_steps);
+  State_Data(int num_slots, int num_elements) : num_slots(num_slots) {
+    x.resize(num_slots, num_elements);
+    y.resize(num_slots, num_elements);
+    z.resize(num_slots, num_elements);
+    vx.resize(num_slots, num_elements);
+    vy.resize(num_slots, num_elements);
+    vz.resize(num_slots, num_elements);
     mass.resize(num_elements);
+  }
+
+  // Whether timestep is still kept once current_timestep is solved
+  bool keeps(int timestep, int current_timestep) const {
+    return timestep <= std::max(current_timestep, 0) && timestep > current_timestep - this->num_slots;
+  }
+};
 
-    for (int i = 0; i < num_time_steps; i++) {
-      x[i].resize(num_elements);
-      y[i].resize(num_elements);
-      z[i].resize(num_elements);
-      vx[i].resize(num_elements);
-      vy[i].resize(num_elements);
-      vz[i].resize(num_elements);
+
+// Conserved quantities of the system, recorded every diagnostic_interval timesteps
+struct Diagnostics_Data {
+  std::vector<int> timestep;
+  std::vector<double> kinetic_energy;
+  std::vector<double> potential_energy;
+  std::vector<double> total_energy;
+  std::vector<double> momentum;          // px, py, pz of each record
+  std::vector<double> angular_momentum;  // Lx, Ly, Lz of each record
+  bool drift_warning_printed = false;
+
+  int num_records() const { return this->timestep.size(); }
+
+  // Change of the total energy from the first record, relative to the
+  // initial energy (absolute if the initial energy is 0, e.g. a bound
+  // system that starts exactly virialized)
+  double energy_drift_to(double total_energy) const {
+    const double change = total_energy - this->total_energy[0];
+    return (this->total_energy[0] != 0) ? change / fabs(this->total_energy[0]) : change;
+  }
+
+  // Drift from the first to the last record
+  double energy_drift() const {
+    if (this->num_records() < 2) {
+      return 0;
     }
+    return this->energy_drift_to(this->total_energy.back());
   }
 };
 
 
+// Solvers that can be stepped one timestep at a time (see System::step)
+enum Solver_Type {
+  SOLVER_DIRECT,
+  SOLVER_FMM,
+  SOLVER_PM
+};
+
+// What output_results_HDF5 writes
+enum Output_Mode {
+  OUTPUT_FULL,    // every position of every element at every timestep
+  OUTPUT_REDUCED  // the in-situ reduction below (no full trajectories)
+};
+
+// In-situ reduction of the state, recorded every reduction_interval timesteps:
+// projected density images, an optional 3D density grid and the
+// trajectories of a subset of tracer elements
+struct Reduction_Data {
+  int image_size = 0;  // pixels per side of each projection
+  int grid_size = 0;   // cells per side of the 3D grid (0 for none)
+  float extent[6] = {0, 0, 0, 0, 0, 0};  // x_min, x_max, y_min, y_max, z_min, z_max (set at the first record)
+  std::vector<int> tracer_idx;  // elements whose trajectories are kept
+
+  std::vector<int> timestep;
+  std::vector<float> projection_xy;  // [record][y][x], mass per pixel
+  std::vector<float> projection_xz;  // [record][z][x]
+  std::vector<float> projection_yz;  // [record][z][y]
+  std::vector<float> density_grid;   // [record][z][y][x], mass per cell
+  std::vector<double> mass_outside;  // mass outside the extent at each record
+  std::vector<float> tracer_x;       // [record][tracer]
+  std::vector<float> tracer_y;
+  std::vector<float> tracer_z;
+
+  int num_records() const { return this->timestep.size(); }
+};
+
+
 struct Block {
   // Stuff initialized only once
   // struct Block** children;
@@ -52,6 +145,8 @@ struct Block {
   std::vector<Block> children;
   int layer;  // 0 is the base layer
   int layer_idx;  // 0-7 for each layer
+  int num_layers;  // layer of the leaves (depth of the whole tree)
+  int ix, iy, iz;  // position of the block within its layer (0 to 2^layer - 1)
 
   // Stuff re-initialized every time step
   int num_elements;
@@ -64,12 +159,23 @@ struct Block {
   Block() : Block(0, -1, nullptr) {}
 
   // Constructor
-  Block(const int layer, const int layer_idx, Block* parent) : layer(layer), layer_idx(layer_idx), parent(parent) {
+  Block(const int layer, const int layer_idx, Block* parent, const int num_layers = NUM_LAYERS) : layer(layer), layer_idx(layer_idx), num_layers(num_layers), parent(parent) {
+    // (bit 0 of layer_idx is the x half, bit 1 the y half, bit 2 the z half)
+    if (parent != nullptr) {
+      this->ix = 2 * parent->ix + (layer_idx & 1);
+      this->iy = 2 * parent->iy + ((layer_idx >> 1) & 1);
+      this->iz = 2 * parent->iz + ((layer_idx >> 2) & 1);
+    } else {
+      this->ix = 0;
+      this->iy = 0;
+      this->iz = 0;
+    }
+
     // Recursively initialize children (until lowest layer)
-    if (this->layer < NUM_LAYERS) {
+    if (this->layer < this->num_layers) {
       for (int i = 0; i < NUM_BLOCKS_PER_LAYER; i++) {
         // printf("[layer %d]Creating Child Block %d\n", this->layer, i);
-        this->children.emplace_back(this->layer + 1, i, this);
+        this->children.emplace_back(this->layer + 1, i, this, this->num_layers);
         // printf("[layer %d]Created Child Block %d\n", this->layer, i);
       }
     }
@@ -82,7 +188,7 @@ struct Block {
     }
 
     // Recursively initialize children (until lowest layer)
-    if (this->layer < NUM_LAYERS) {
+    if (this->layer < this->num_layers) {
       for (int i = 0; i < NUM_BLOCKS_PER_LAYER; i++) {
         this->children[i].initialize_parent(this);
       }
@@ -126,7 +232,9 @@ struct System {
   struct State_Data state;
 
   // Constructor
-  System(float ic_data[][NUM_VALUES], const int num_elements, const int num_time_steps, const float delta_t);
+  // (the reduced output only keeps the latest timesteps of the state, see State_History)
+  System(float ic_data[][NUM_VALUES], const int num_elements, const int num_time_steps, const float delta_t,
+      const Output_Mode output_mode = DEFAULT_OUTPUT_MODE);
 
   // Destructor
   ~System();
@@ -140,20 +248,78 @@ struct System {
   void interpolate_position(int curr_timestep);
 
   // Calculate the gravitational force between any two objects
-  void static Calculate_Gravitational_Force(float pos_x1, float pos_x2, float pos_y1, float pos_y2, float pos_z1, float pos_z2, float mass1, float mass2, float* force_x, float* force_y, float* force_z);
+  void static Calculate_Gravitational_Force(real_t pos_x1, real_t pos_x2, real_t pos_y1, real_t pos_y2, real_t pos_z1, real_t pos_z2, real_t mass1, real_t mass2, real_t* force_x, real_t* force_y, real_t* force_z);
 
   // Direct Solver Methods
+  Precision_Policy precision_policy;  // used by the direct solver
+  int direct_tile_size;  // elements per tile of the direct kernel
   void solve_direct();
   void update_velocity_direct(int curr_timestep);
-  void calculate_gravitational_force_direct(int element_1, int element_2, int curr_timestep, float* force_x, float* force_y, float* force_z);
+  template <typename Policy>
+  void update_velocity_direct_tiled(int curr_timestep);  // defined in direct_solver.cpp
+  void calculate_gravitational_force_direct(int element_1, int element_2, int curr_timestep, real_t* force_x, real_t* force_y, real_t* force_z);
 
   // FMM Solver Methods & Variables
   struct Block base_block;
   // struct Block* base_block = nullptr;
+  int tree_depth;  // layer of the leaves of base_block (also used by the PM solver)
+  void build_tree();
+  int fmm_order;  // Chebyshev nodes per dimension
+  struct FMM_Operators fmm_operators;
+  std::vector<FMM_Level> fmm_levels;  // one per layer of base_block
   void solve_fmm();
-  // void initialize_fmm();
+  void initialize_fmm();
   void decompose_domain_fmm(int curr_timestep);
   void solve_time_step_fmm(int curr_timestep);
+  double potential_energy_fmm(int curr_timestep);
+  // (the kernels are compiled per expansion order, defined in fmm_solver.cpp)
+  template <int Order>
+  void solve_time_step_fmm_order(int curr_timestep);
+  template <int Order>
+  double potential_energy_fmm_order(int curr_timestep);
+  template <int Order>
+  void compute_expansions_fmm(int curr_timestep);
+  template <int Order>
+  void upward_pass_fmm(int curr_timestep);
+  template <int Order>
+  void downward_pass_fmm();
+  template <int Order, typename Policy>
+  void evaluate_leaves_fmm(int curr_timestep);
+
+  // PM (Particle-Mesh) Solver Methods & Variables
+  int pm_grid_size;     // nodes per dimension (a power of 2)
+  bool pm_use_tsc;      // TSC instead of CIC mass assignment
+  bool pm_short_range;  // add the short-range correction (P3M)
+  float pm_split_scale; // r_s of the force split, in grid spacings
+  struct PM_Grid pm_grid;
+  void solve_pm();
+  void initialize_pm();
+  void update_velocity_pm(int curr_timestep);
+  void deposit_mass_pm(int curr_timestep);
+  void solve_potential_pm();
+  void interpolate_field_pm(int curr_timestep);
+  void short_range_pm(int curr_timestep);
+
+  // Diagnostics (defined in diagnostics.cpp)
+  int diagnostic_interval;  // timesteps between records (0 disables them)
+  struct Diagnostics_Data diagnostics;
+  void record_diagnostics(int curr_timestep);
+  double potential_energy_direct(int curr_timestep);
+  void print_diagnostics_summary();
+
+  // Stepping one timestep at a time, for callers that drive the solve
+  // themselves (the Python module) (defined in stepping.cpp)
+  Solver_Type solver_type;
+  int current_timestep;  // last solved timestep (-1 before start_solver)
+  void start_solver(Solver_Type solver);
+  bool step();
+
+  // In-situ reduction (defined in reduction.cpp)
+  Output_Mode output_mode;  // (set by the constructor, it sizes the state)
+  int reduction_interval;  // timesteps between records (only used by OUTPUT_REDUCED)
+  struct Reduction_Data reduction;
+  void select_tracers(int num_tracers);
+  void record_reduction(int curr_timestep);
   
 };
 
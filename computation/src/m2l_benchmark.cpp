@@ -0,0 +1,103 @@
+/* Micro-benchmark for the FMM M2L translations.
+   Times the batched (per offset) kernel against a per-pair loop
+   on one fully occupied layer, and reports GFLOP/s for both. */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono> // for timing (clock() is too coarse here)
+#include <stdlib.h> // for atoi, rand
+#include <math.h> // for fabs
+#include <algorithm> // for std::min, std::max, std::fill
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/fmm.hpp"
+
+
+// Reference: apply the operator of each pair on its own
+static void m2l_pairwise(const FMM_Operators& operators, FMM_Level& level) {
+  const int n = operators.num_nodes;
+  const float scale = 1.0 / level.half_width;
+  for (int offset = 0; offset < (int) operators.m2l.size(); offset++) {
+    const float* op = operators.m2l[offset].data();
+    for (int pair = 0; pair < (int) level.m2l_targets[offset].size(); pair++) {
+      const float* multipole = &level.multipole[level.m2l_sources[offset][pair] * n];
+      float* local = &level.local[level.m2l_targets[offset][pair] * n];
+      for (int a = 0; a < n; a++) {
+        float sum = 0;
+        for (int b = 0; b < n; b++) {
+          sum += op[b * n + a] * multipole[b];
+        }
+        local[a] += scale * sum;
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  // Usage: M2L_Benchmark_exe [order] [layer] [repetitions]
+  const int order = (argc > 1) ? atoi(argv[1]) : FMM_ORDER;
+  const int layer = (argc > 2) ? atoi(argv[2]) : 4;
+  const int repetitions = (argc > 3) ? atoi(argv[3]) : 5;
+  if (order < FMM_MIN_ORDER || order > FMM_MAX_ORDER) {
+    printf("The M2L kernel is compiled for orders %d to %d\n", FMM_MIN_ORDER, FMM_MAX_ORDER);
+    return 1;
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  FMM_Operators operators(order);
+  auto end_time = std::chrono::steady_clock::now();
+  printf("Built %d M2L operators (order %d, %d nodes) in %f seconds\n",
+      (int) operators.m2l.size(), order, operators.num_nodes,
+      std::chrono::duration<double>(end_time - start_time).count());
+
+  // A fully occupied layer with random multipoles
+  FMM_Level level(layer, operators.num_nodes);
+  level.half_width = 1.0;
+  for (int cell = 0; cell < level.num_cells; cell++) {
+    level.occupied[cell] = 1;
+  }
+  for (float& weight : level.multipole) {
+    weight = (rand() % 1000) / 1000.0;
+  }
+  fmm_build_interaction_lists(operators, level);
+
+  long long num_pairs = 0;
+  for (const std::vector<int>& targets : level.m2l_targets) {
+    num_pairs += targets.size();
+  }
+  const double flops = 2.0 * operators.num_nodes * operators.num_nodes * num_pairs;
+  printf("Layer %d: %d cells, %lld M2L pairs, %f GFLOP per pass\n", layer, level.num_cells, num_pairs, flops * 1e-9);
+
+  // Time both kernels, keeping the fastest pass of each
+  double best_batched = 1e30, best_pairwise = 1e30;
+  numa_vector<float> batched_local, pairwise_local;
+  for (int repetition = 0; repetition < repetitions; repetition++) {
+    std::fill(level.local.begin(), level.local.end(), 0.0f);
+    start_time = std::chrono::steady_clock::now();
+    fmm_m2l_batched(operators, level);
+    end_time = std::chrono::steady_clock::now();
+    best_batched = std::min(best_batched, std::chrono::duration<double>(end_time - start_time).count());
+    batched_local = level.local;
+
+    std::fill(level.local.begin(), level.local.end(), 0.0f);
+    start_time = std::chrono::steady_clock::now();
+    m2l_pairwise(operators, level);
+    end_time = std::chrono::steady_clock::now();
+    best_pairwise = std::min(best_pairwise, std::chrono::duration<double>(end_time - start_time).count());
+    pairwise_local = level.local;
+  }
+
+  // Both kernels should agree (up to rounding)
+  double max_difference = 0, max_value = 0;
+  for (int i = 0; i < (int) batched_local.size(); i++) {
+    max_difference = std::max(max_difference, (double) fabs(batched_local[i] - pairwise_local[i]));
+    max_value = std::max(max_value, (double) fabs(pairwise_local[i]));
+  }
+
+  printf("Batched:  %f seconds, %f GFLOP/s\n", best_batched, flops * 1e-9 / best_batched);
+  printf("Pairwise: %f seconds, %f GFLOP/s\n", best_pairwise, flops * 1e-9 / best_pairwise);
+  printf("Max relative difference: %e\n", max_difference / max_value);
+  return 0;
+}
@@ -3,51 +3,149 @@
 #include <H5Cpp.h>
 #include <time.h> // for timing
 #include <algorithm> // for std::copy
+#include <vector>
+#include <stdlib.h> // for atoi, atof
 
 #include "include/parameters.hpp"
 #include "include/declarations.hpp"
 #include "include/system.hpp"
+#include "include/ensemble.hpp"
+#include "include/numa.hpp"
+#include "include/autotune.hpp"
 
 using namespace H5; // temp
 
-int main(int argc, char *argv[]) {
-
-  std::string input_filename = "data/initial_conditions.hdf5";
-  if (argc > 1) {
-    input_filename = argv[1];
-  }
-  printf("Reading initial conditions from %s\n", input_filename.c_str());
+// Reads every group of the file as the initial conditions of one system
+// (each group holds a "dataset" like a single system file), solves them
+// all together and writes them to data/ensemble_results.hdf5
+static void run_ensemble(std::string input_filename, const int num_time_steps, const float time_step_size) {
+  printf("Reading ensemble initial conditions from %s\n", input_filename.c_str());
   clock_t start_time, end_time;
   double time_taken;
   start_time = clock();
 
-  // Open the ic_file for reading
-  H5File ic_file(input_filename, H5F_ACC_RDONLY); 
+  std::vector<std::vector<float>> ic_data;
+  std::vector<std::string> names;
+
+  // Open the file once for every system
+  H5File ic_file(input_filename, H5F_ACC_RDONLY);
+  for (hsize_t idx = 0; idx < ic_file.getNumObjs(); idx++) {
+    std::string name = ic_file.getObjnameByIdx(idx);
+    if (ic_file.childObjType(name) != H5O_TYPE_GROUP) {
+      continue;
+    }
+    DataSet ic_dataset = ic_file.openDataSet(name + "/dataset");
+    hsize_t dims[2];
+    ic_dataset.getSpace().getSimpleExtentDims(dims);
+
+    ic_data.emplace_back(dims[0] * NUM_VALUES);
+    ic_dataset.read(ic_data.back().data(), PredType::NATIVE_FLOAT);
+    ic_dataset.close();
+    names.push_back(name);
+  }
+  ic_file.close();
 
-  // Open the ic_dataset
-  DataSet ic_dataset = ic_file.openDataSet("dataset");
+  end_time = clock();
+  time_taken = double(end_time - start_time) / double(CLOCKS_PER_SEC);
+  printf("Done. Read %d systems. Time taken: %f seconds\n", (int) ic_data.size(), time_taken);
 
-  // Get the ic_dataspace
-  DataSpace ic_dataspace = ic_dataset.getSpace();
+  Ensemble ensemble(ic_data, names, num_time_steps, time_step_size);
+  ensemble.solve();
+  output_ensemble_HDF5(ensemble);
+}
 
-  // Get the dimensions of the ic_dataspace
-  int rank = ic_dataspace.getSimpleExtentNdims();
-  hsize_t dims[rank];
-  ic_dataspace.getSimpleExtentDims(dims);
-  // const hsize_t ic_num_values = dims[0];
-  const hsize_t num_elements = dims[0];
-  // printf("Number of elements: %d\n", num_elements);
+int main(int argc, char *argv[]) {
 
-  // Read the ic_data to a buffer
-  float ic_data[num_elements][NUM_VALUES];
-  ic_dataset.read(ic_data, PredType::NATIVE_FLOAT);
+  // Usage: Solver_exe [input_filename] [--ensemble] [--solver direct|fmm|pm|auto]
+  //                   [--pin none|compact|spread] [--huge-pages] [--no-first-touch]
+  //                   [--output full|reduced] [--tracers N] [--tracer-ids i,j,k]
+  //                   [--error-budget E] [--retune]
+  const char* usage = "Usage: Solver_exe [input_filename] [--ensemble] [--solver direct|fmm|pm|auto]\n"
+                      "                  [--pin none|compact|spread] [--huge-pages] [--no-first-touch]\n"
+                      "                  [--output full|reduced] [--tracers N] [--tracer-ids i,j,k]\n"
+                      "                  [--error-budget E] [--retune]\n";
+  std::string input_filename = "data/initial_conditions.hdf5";
+  std::string solver = "direct";
+  Output_Mode output_mode = DEFAULT_OUTPUT_MODE;
+  int num_tracers = REDUCTION_NUM_TRACERS;
+  std::vector<int> tracer_ids;
+  double error_budget = AUTOTUNE_ERROR_BUDGET;
+  bool retune = false;
+  bool ensemble_mode = false;
+  for (int i = 1; i < argc; i++) {
+    std::string argument = argv[i];
+    if (argument == "--ensemble") {
+      ensemble_mode = true;
+    } else if (argument == "--solver" && i + 1 < argc) {
+      solver = argv[++i];
+      if (solver != "direct" && solver != "fmm" && solver != "pm" && solver != "auto") {
+        printf("Unknown solver: %s\n%s", solver.c_str(), usage);
+        return 1;
+      }
+    } else if (argument == "--pin" && i + 1 < argc) {
+      std::string pinning = argv[++i];
+      if (pinning == "compact") {
+        numa_settings.pinning = PIN_COMPACT;
+      } else if (pinning == "spread") {
+        numa_settings.pinning = PIN_SPREAD;
+      } else if (pinning == "none") {
+        numa_settings.pinning = PIN_NONE;
+      } else {
+        printf("Unknown pinning: %s\n%s", pinning.c_str(), usage);
+        return 1;
+      }
+    } else if (argument == "--output" && i + 1 < argc) {
+      std::string output = argv[++i];
+      if (output != "full" && output != "reduced") {
+        printf("Unknown output: %s\n%s", output.c_str(), usage);
+        return 1;
+      }
+      output_mode = (output == "reduced") ? OUTPUT_REDUCED : OUTPUT_FULL;
+    } else if (argument == "--tracers" && i + 1 < argc) {
+      num_tracers = atoi(argv[++i]);
+    } else if (argument == "--tracer-ids" && i + 1 < argc) {
+      // comma separated element indices
+      std::string ids = argv[++i];
+      for (size_t start = 0; start < ids.size(); ) {
+        size_t end = ids.find(',', start);
+        if (end == std::string::npos) {
+          end = ids.size();
+        }
+        tracer_ids.push_back(atoi(ids.substr(start, end - start).c_str()));
+        start = end + 1;
+      }
+    } else if (argument == "--error-budget" && i + 1 < argc) {
+      error_budget = atof(argv[++i]);
+    } else if (argument == "--retune") {
+      retune = true;
+    } else if (argument == "--huge-pages") {
+      numa_settings.huge_pages = true;
+    } else if (argument == "--no-first-touch") {
+      numa_settings.first_touch = false;
+    } else {
+      input_filename = argument;
+    }
+  }
 
-  ic_dataset.close();
-  ic_file.close();
+  const int num_time_steps = 200; // 365 @ 1.0 = 1 year
+  const float time_step_size = 1.0; // 1 day per timestep
 
-  end_time = clock();
-  time_taken = double(end_time - start_time) / double(CLOCKS_PER_SEC);
-  printf("Done. Time taken: %f seconds\n", time_taken);
+  // Pin the threads before anything is allocated (first touch places
+  // the pages on the node of the thread that writes them)
+  pin_threads(numa_settings.pinning);
+  printf("NUMA nodes: %d, thread pinning: %s, huge pages: %s\n", numa_num_nodes(),
+      pinning_name(numa_settings.pinning), numa_settings.huge_pages ? "on" : "off");
+
+  if (ensemble_mode) {
+    run_ensemble(input_filename, num_time_steps, time_step_size);
+    printf("All Done Solving.\n");
+    return 0;
+  }
+
+  // Read the initial conditions (NUM_VALUES floats per element)
+  std::vector<float> ic_buffer = read_initial_conditions_HDF5(input_filename);
+  const int num_elements = ic_buffer.size() / NUM_VALUES;
+  float (*ic_data)[NUM_VALUES] = reinterpret_cast<float(*)[NUM_VALUES]>(ic_buffer.data());
 
 
 
@@ -56,11 +154,22 @@ int main(int argc, char *argv[]) {
 
 
   // Initialize the system
-  const int num_time_steps = 200; // 365 @ 1.0 = 1 year
-  const float time_step_size = 1.0; // 1 day per timestep
   // printf("System constructor outside\n");
-  struct System system(ic_data, num_elements, num_time_steps, time_step_size);
+  struct System system(ic_data, num_elements, num_time_steps, time_step_size, output_mode);
   // printf("System constructor finished\n");
+
+  // Reduced output: the given tracers, or num_tracers evenly spaced ones
+  if (output_mode == OUTPUT_REDUCED) {
+    system.select_tracers(num_tracers);
+    if (!tracer_ids.empty()) {
+      system.reduction.tracer_idx.clear();
+      for (int element : tracer_ids) {
+        if (element >= 0 && element < (int) num_elements) {
+          system.reduction.tracer_idx.push_back(element);
+        }
+      }
+    }
+  }
   // printf("0 layer: %d\n", system.base_block.layer);
 
 
@@ -70,13 +179,26 @@ int main(int argc, char *argv[]) {
   // }
 
 
-  // Solve the system with both the FMM and direct solvers
-  // system.solve_fmm();
-  system.solve_direct();
+  // The auto-tuner picks the solver and its settings
+  // (calibrated on this input, or cached from an earlier run)
+  if (solver == "auto") {
+    Tuning_Profile profile = autotune_solver(ic_data, num_elements, num_time_steps, error_budget, !retune);
+    apply_tuning_profile(system, profile);
+    solver = solver_name(profile.solver);
+  }
+
+  // Solve the system with the chosen solver
+  if (solver == "fmm") {
+    system.solve_fmm();
+  } else if (solver == "pm") {
+    system.solve_pm();
+  } else {
+    system.solve_direct();
+  }
   
 
 
-  // Output the results (from the direct solver) to a file
+  // Output the results to a file
   output_results_HDF5(system);
 
   printf("All Done Solving.\n");
@@ -0,0 +1,191 @@
+/* This file holds the NUMA placement of the large arrays
+   (parallel first touch, huge pages) and the thread pinning. */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <new> // for std::bad_alloc
+#include <stdlib.h> // for posix_memalign, free
+#include <unistd.h> // for sysconf
+#include <sched.h> // for sched_getaffinity, CPU_*
+#include <pthread.h> // for pthread_setaffinity_np
+#include <sys/mman.h> // for madvise
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "include/parameters.hpp"
+#include "include/numa.hpp"
+
+// Size (and alignment) of a transparent huge page
+#define NUMA_HUGE_PAGE_SIZE (2 << 20)
+
+// Arrays smaller than this are not worth a parallel first touch
+#define NUMA_MIN_TOUCH_BYTES (64 << 10)
+
+
+Numa_Settings numa_settings = {NUMA_THREAD_PINNING, NUMA_FIRST_TOUCH, NUMA_HUGE_PAGES};
+
+
+// Cpus of each node, from sysfs ("0-3,8-11" lists)
+// (a single node holding every cpu if there is no NUMA information)
+static std::vector<std::vector<int>> node_cpus() {
+  std::vector<std::vector<int>> nodes;
+  for (int node = 0; ; node++) {
+    std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+      break;
+    }
+    std::vector<int> cpus;
+    int first, last;
+    while (fscanf(file, "%d", &first) == 1) {
+      last = first;
+      int separator = fgetc(file);
+      if (separator == '-') {
+        if (fscanf(file, "%d", &last) != 1) {
+          break;
+        }
+        separator = fgetc(file);
+      }
+      for (int cpu = first; cpu <= last; cpu++) {
+        cpus.push_back(cpu);
+      }
+      if (separator != ',') {
+        break;
+      }
+    }
+    fclose(file);
+    nodes.push_back(cpus);
+  }
+
+  if (nodes.empty()) {
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < (int) sysconf(_SC_NPROCESSORS_ONLN); cpu++) {
+      cpus.push_back(cpu);
+    }
+    nodes.push_back(cpus);
+  }
+  return nodes;
+}
+
+int numa_num_nodes() {
+  return node_cpus().size();
+}
+
+const char* pinning_name(Thread_Pinning pinning) {
+  switch (pinning) {
+    case PIN_COMPACT:
+      return "compact";
+    case PIN_SPREAD:
+      return "spread";
+    default:
+      return "none";
+  }
+}
+
+void pin_threads(Thread_Pinning pinning) {
+  if (pinning == PIN_NONE) {
+    return;
+  }
+
+  // Only the cpus this process is allowed to run on
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    printf("Warning: could not read the cpu affinity, threads are not pinned\n");
+    return;
+  }
+  std::vector<std::vector<int>> nodes = node_cpus();
+  for (std::vector<int>& cpus : nodes) {
+    std::vector<int> usable;
+    for (int cpu : cpus) {
+      if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+        usable.push_back(cpu);
+      }
+    }
+    cpus = usable;
+  }
+
+  // Order in which the threads take the cpus
+  std::vector<int> order;
+  if (pinning == PIN_COMPACT) {
+    for (const std::vector<int>& cpus : nodes) {
+      order.insert(order.end(), cpus.begin(), cpus.end());
+    }
+  } else {
+    for (int rank = 0; ; rank++) {
+      bool any = false;
+      for (const std::vector<int>& cpus : nodes) {
+        if (rank < (int) cpus.size()) {
+          order.push_back(cpus[rank]);
+          any = true;
+        }
+      }
+      if (!any) {
+        break;
+      }
+    }
+  }
+  if (order.empty()) {
+    return;
+  }
+
+  // Every thread of the pool pins itself (thread t to order[t])
+  #pragma omp parallel
+  {
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(order[thread % order.size()], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+}
+
+void* numa_allocate(size_t bytes) {
+  if (bytes == 0) {
+    return nullptr;
+  }
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const bool huge = numa_settings.huge_pages && bytes >= NUMA_HUGE_PAGE_SIZE;
+
+  // (large arrays start on a page, the others on a cache line)
+  size_t alignment = 64;
+  if (huge) {
+    alignment = NUMA_HUGE_PAGE_SIZE;
+  } else if (bytes >= NUMA_MIN_TOUCH_BYTES) {
+    alignment = page_size;
+  }
+
+  void* pointer = nullptr;
+  if (posix_memalign(&pointer, alignment, bytes) != 0) {
+    throw std::bad_alloc();
+  }
+
+#ifdef MADV_HUGEPAGE
+  if (huge) {
+    madvise(pointer, bytes - bytes % NUMA_HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+  }
+#endif
+
+  // First touch: one byte of every page, split between the threads like
+  // the elements of a static schedule (so each page lands on the node of
+  // the thread that will work on it)
+  if (numa_settings.first_touch && bytes >= NUMA_MIN_TOUCH_BYTES) {
+    char* memory = static_cast<char*>(pointer);
+    const long num_pages = (bytes + page_size - 1) / page_size;
+    #pragma omp parallel for schedule(static)
+    for (long page = 0; page < num_pages; page++) {
+      memory[page * page_size] = 0;
+    }
+  }
+  return pointer;
+}
+
+// (the size is not needed, both paths of numa_allocate use posix_memalign)
+void numa_deallocate(void* pointer, size_t /* bytes */) {
+  free(pointer);
+}
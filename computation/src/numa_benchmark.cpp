@@ -0,0 +1,85 @@
+/* Benchmark of the NUMA placement of the state arrays.
+   Times the bandwidth bound state update (propogate_state and
+   interpolate_position) for each thread count, with the state placed by
+   one thread and with the parallel first touch, and reports GB/s. */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono> // for timing
+#include <stdlib.h> // for atoi, rand
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/system.hpp"
+#include "include/numa.hpp"
+
+
+// GB/s of the state update of one system over a few repetitions
+static double state_update_bandwidth(const std::vector<float>& ic_data, const int num_elements, const int repetitions) {
+  System system(reinterpret_cast<float(*)[NUM_VALUES]>(const_cast<float*>(ic_data.data())), num_elements, 2, 1.0);
+
+  // (one untimed pass, so every thread has run once)
+  system.propogate_state(1);
+  system.interpolate_position(1);
+
+  auto start_time = std::chrono::steady_clock::now();
+  for (int repetition = 0; repetition < repetitions; repetition++) {
+    system.propogate_state(1);
+    system.interpolate_position(1);
+  }
+  auto end_time = std::chrono::steady_clock::now();
+  const double time_taken = std::chrono::duration<double>(end_time - start_time).count();
+
+  // propogate_state reads 6 arrays and writes 6,
+  // interpolate_position reads 6 and writes 3
+  const double bytes = 21.0 * sizeof(real_t) * num_elements * repetitions;
+  return bytes * 1e-9 / time_taken;
+}
+
+int main(int argc, char *argv[]) {
+  // Usage: NUMA_Benchmark_exe [num_elements] [repetitions] [none|compact|spread]
+  const int num_elements = (argc > 1) ? atoi(argv[1]) : (1 << 23);
+  const int repetitions = (argc > 2) ? atoi(argv[2]) : 20;
+  if (argc > 3) {
+    std::string pinning = argv[3];
+    numa_settings.pinning = (pinning == "compact") ? PIN_COMPACT : (pinning == "spread") ? PIN_SPREAD : PIN_NONE;
+  }
+
+  int max_threads = 1;
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+  pin_threads(numa_settings.pinning);
+  printf("NUMA benchmark: %d elements, %d repetitions, %d threads, %d NUMA nodes, pinning %s\n",
+      num_elements, repetitions, max_threads, numa_num_nodes(), pinning_name(numa_settings.pinning));
+
+  std::vector<float> ic_data(num_elements * NUM_VALUES);
+  for (float& value : ic_data) {
+    value = (rand() % 1000) / 1000.0;
+  }
+
+  printf("%8s %16s %16s %8s\n", "threads", "one thread GB/s", "first touch GB/s", "ratio");
+  for (int num_threads = 1; ; num_threads = std::min(2 * num_threads, max_threads)) {
+#ifdef _OPENMP
+    omp_set_num_threads(num_threads);
+#endif
+    // Every page written by the main thread (the single allocation case)
+    numa_settings.first_touch = false;
+    const double serial_bandwidth = state_update_bandwidth(ic_data, num_elements, repetitions);
+
+    // Pages touched with the static partition of the update loops
+    numa_settings.first_touch = true;
+    const double first_touch_bandwidth = state_update_bandwidth(ic_data, num_elements, repetitions);
+
+    printf("%8d %16.2f %16.2f %8.2f\n", num_threads, serial_bandwidth, first_touch_bandwidth,
+        first_touch_bandwidth / serial_bandwidth);
+    if (num_threads == max_threads) {
+      break;
+    }
+  }
+  return 0;
+}
@@ -1,24 +1,56 @@
-/* This file holds the functions used to write to HDF5. */
+/* This file holds the functions used to read from and write to HDF5. */
 
 #include <iostream>
 #include <string>
 #include <H5Cpp.h>
 #include <time.h> // for timing
 #include <algorithm> // for std::copy
+#include <vector>
 
 #include "include/parameters.hpp"
 #include "include/declarations.hpp"
 #include "include/system.hpp"
+#include "include/ensemble.hpp"
 
 using namespace H5; // for convenience
 
-void output_results_HDF5(System system) {
+std::vector<float> read_initial_conditions_HDF5(std::string input_filename) {
+  printf("Reading initial conditions from %s\n", input_filename.c_str());
+  clock_t start_time, end_time;
+  double time_taken;
+  start_time = clock();
+
+  // Open the ic_file for reading
+  H5File ic_file(input_filename, H5F_ACC_RDONLY);
+
+  // Open the ic_dataset
+  DataSet ic_dataset = ic_file.openDataSet("dataset");
+
+  // Get the dimensions of the ic_dataspace
+  hsize_t dims[2];
+  ic_dataset.getSpace().getSimpleExtentDims(dims);
+  const hsize_t num_elements = dims[0];
+
+  // Read the ic_data to a buffer
+  // (on the heap, large inputs do not fit on the stack)
+  std::vector<float> ic_buffer(num_elements * NUM_VALUES);
+  ic_dataset.read(ic_buffer.data(), PredType::NATIVE_FLOAT);
+
+  ic_dataset.close();
+  ic_file.close();
+
+  end_time = clock();
+  time_taken = double(end_time - start_time) / double(CLOCKS_PER_SEC);
+  printf("Done. Time taken: %f seconds\n", time_taken);
+  return ic_buffer;
+}
+
+void output_results_HDF5(System& system, std::string output_filename) {
   clock_t start_time, end_time;
   double time_taken;
 
   // TODO: write mass to output for plotting??
   // Write results to new HDF5 file
-  std::string output_filename = "data/results.hdf5";
   printf("Writing results to %s\n", output_filename.c_str());
   start_time = clock();
 
@@ -27,34 +59,41 @@ void output_results_HDF5(System system) {
 
 
   /********************** Position Data **********************/
-  int const position_num_values = 3; // x, y, z
+  // (the reduced output only keeps the tracers, in the "reduced" group)
+  if (system.output_mode == OUTPUT_FULL) {
+    int const position_num_values = 3; // x, y, z
 
-  // Dataspace
-  hsize_t const position_DIMS[3] = {position_num_values,
-      static_cast<hsize_t>(system.num_time_steps),
-      static_cast<hsize_t>(system.num_elements)}; 
-  DataSpace position_dataspace(3, position_DIMS);
+    // Dataspace
+    hsize_t const position_DIMS[3] = {position_num_values,
+        static_cast<hsize_t>(system.num_time_steps),
+        static_cast<hsize_t>(system.num_elements)}; 
+    DataSpace position_dataspace(3, position_DIMS);
 
-  // Dataset
-  DataSet position_dataset = out_file.createDataSet("positions",
-      PredType::NATIVE_FLOAT,
-      position_dataspace);
+    // Dataset
+    DataSet position_dataset = out_file.createDataSet("positions",
+        PredType::NATIVE_FLOAT,
+        position_dataspace);
   
-  // Buffer
-  float positions[position_num_values][system.num_time_steps][system.num_elements];
+    // Buffer [value][timestep][element]
+    // (on the heap, it outgrows the stack for a few thousand elements,
+    // and the pipeline writes from a thread with a smaller one)
+    const int num_time_steps = system.num_time_steps;
+    const int num_elements = system.num_elements;
+    std::vector<float> positions((size_t) position_num_values * num_time_steps * num_elements);
 
-  // Populate Buffer
-  for (int timestep = 0; timestep < system.num_time_steps; timestep++) {
-    for (int element = 0; element < system.num_elements; element++) {
-      positions[0][timestep][element] = system.state.x[timestep][element];
-      positions[1][timestep][element] = system.state.y[timestep][element];
-      positions[2][timestep][element] = system.state.z[timestep][element];
+    // Populate Buffer
+    for (int timestep = 0; timestep < num_time_steps; timestep++) {
+      for (int element = 0; element < num_elements; element++) {
+        positions[((size_t) 0 * num_time_steps + timestep) * num_elements + element] = system.state.x[timestep][element];
+        positions[((size_t) 1 * num_time_steps + timestep) * num_elements + element] = system.state.y[timestep][element];
+        positions[((size_t) 2 * num_time_steps + timestep) * num_elements + element] = system.state.z[timestep][element];
+      }
     }
-  }
 
-  // File Write
-  position_dataset.write(positions, PredType::NATIVE_FLOAT);  
-  position_dataset.close();
+    // File Write
+    position_dataset.write(positions.data(), PredType::NATIVE_FLOAT);
+    position_dataset.close();
+  }
 
 
   /********************** Mass Data **********************/
@@ -68,7 +107,7 @@ void output_results_HDF5(System system) {
       mass_dataspace);
   
   // Buffer
-  float masses[system.num_elements];
+  std::vector<float> masses(system.num_elements);
 
   // Populate Buffer
   for (int element = 0; element < system.num_elements; element++) {
@@ -76,10 +115,108 @@ void output_results_HDF5(System system) {
   }
 
   // File Write
-  mass_dataset.write(masses, PredType::NATIVE_FLOAT);  
+  mass_dataset.write(masses.data(), PredType::NATIVE_FLOAT);  
   mass_dataset.close();
 
 
+  /********************** Diagnostics **********************/
+  // Time series of the conserved quantities (if any were recorded)
+  const Diagnostics_Data& diagnostics = system.diagnostics;
+  if (diagnostics.num_records() > 0) {
+    Group diagnostics_group = out_file.createGroup("diagnostics");
+    hsize_t const series_DIMS[1] = {static_cast<hsize_t>(diagnostics.num_records())};
+    hsize_t const vector_DIMS[2] = {static_cast<hsize_t>(diagnostics.num_records()), 3};
+    DataSpace series_dataspace(1, series_DIMS);
+    DataSpace vector_dataspace(2, vector_DIMS);
+
+    diagnostics_group.createDataSet("timestep", PredType::NATIVE_INT, series_dataspace)
+        .write(diagnostics.timestep.data(), PredType::NATIVE_INT);
+    diagnostics_group.createDataSet("kinetic_energy", PredType::NATIVE_DOUBLE, series_dataspace)
+        .write(diagnostics.kinetic_energy.data(), PredType::NATIVE_DOUBLE);
+    diagnostics_group.createDataSet("potential_energy", PredType::NATIVE_DOUBLE, series_dataspace)
+        .write(diagnostics.potential_energy.data(), PredType::NATIVE_DOUBLE);
+    diagnostics_group.createDataSet("total_energy", PredType::NATIVE_DOUBLE, series_dataspace)
+        .write(diagnostics.total_energy.data(), PredType::NATIVE_DOUBLE);
+    diagnostics_group.createDataSet("momentum", PredType::NATIVE_DOUBLE, vector_dataspace)
+        .write(diagnostics.momentum.data(), PredType::NATIVE_DOUBLE);
+    diagnostics_group.createDataSet("angular_momentum", PredType::NATIVE_DOUBLE, vector_dataspace)
+        .write(diagnostics.angular_momentum.data(), PredType::NATIVE_DOUBLE);
+    diagnostics_group.close();
+  }
+
+
+  /********************** Reduced Output **********************/
+  // Density projections, 3D grid and tracer trajectories of each record
+  const Reduction_Data& reduction = system.reduction;
+  if (system.output_mode == OUTPUT_REDUCED && reduction.num_records() > 0) {
+    const hsize_t num_records = reduction.num_records();
+    const hsize_t image_size = reduction.image_size;
+    const hsize_t grid_size = reduction.grid_size;
+    const hsize_t num_tracers = reduction.tracer_idx.size();
+    Group reduced_group = out_file.createGroup("reduced");
+
+    hsize_t const series_DIMS[1] = {num_records};
+    DataSpace series_dataspace(1, series_DIMS);
+    reduced_group.createDataSet("timestep", PredType::NATIVE_INT, series_dataspace)
+        .write(reduction.timestep.data(), PredType::NATIVE_INT);
+    reduced_group.createDataSet("mass_outside", PredType::NATIVE_DOUBLE, series_dataspace)
+        .write(reduction.mass_outside.data(), PredType::NATIVE_DOUBLE);
+
+    hsize_t const extent_DIMS[1] = {6};
+    DataSpace extent_dataspace(1, extent_DIMS);
+    reduced_group.createDataSet("extent", PredType::NATIVE_FLOAT, extent_dataspace)
+        .write(reduction.extent, PredType::NATIVE_FLOAT);
+
+    // [record][row][column] images, one compressed chunk per record
+    // (mostly empty pixels, so they compress well)
+    hsize_t const image_DIMS[3] = {num_records, image_size, image_size};
+    hsize_t const image_chunk_DIMS[3] = {1, image_size, image_size};
+    DataSpace image_dataspace(3, image_DIMS);
+    DSetCreatPropList image_properties;
+    image_properties.setChunk(3, image_chunk_DIMS);
+    image_properties.setDeflate(4);
+    reduced_group.createDataSet("projection_xy", PredType::NATIVE_FLOAT, image_dataspace, image_properties)
+        .write(reduction.projection_xy.data(), PredType::NATIVE_FLOAT);
+    reduced_group.createDataSet("projection_xz", PredType::NATIVE_FLOAT, image_dataspace, image_properties)
+        .write(reduction.projection_xz.data(), PredType::NATIVE_FLOAT);
+    reduced_group.createDataSet("projection_yz", PredType::NATIVE_FLOAT, image_dataspace, image_properties)
+        .write(reduction.projection_yz.data(), PredType::NATIVE_FLOAT);
+
+    if (grid_size > 0) {
+      hsize_t const grid_DIMS[4] = {num_records, grid_size, grid_size, grid_size};
+      hsize_t const grid_chunk_DIMS[4] = {1, grid_size, grid_size, grid_size};
+      DataSpace grid_dataspace(4, grid_DIMS);
+      DSetCreatPropList grid_properties;
+      grid_properties.setChunk(4, grid_chunk_DIMS);
+      grid_properties.setDeflate(4);
+      reduced_group.createDataSet("density_grid", PredType::NATIVE_FLOAT, grid_dataspace, grid_properties)
+          .write(reduction.density_grid.data(), PredType::NATIVE_FLOAT);
+    }
+
+    if (num_tracers > 0) {
+      // Same layout as the full "positions" dataset: [x/y/z][record][tracer]
+      std::vector<float> tracer_positions;
+      tracer_positions.insert(tracer_positions.end(), reduction.tracer_x.begin(), reduction.tracer_x.end());
+      tracer_positions.insert(tracer_positions.end(), reduction.tracer_y.begin(), reduction.tracer_y.end());
+      tracer_positions.insert(tracer_positions.end(), reduction.tracer_z.begin(), reduction.tracer_z.end());
+      std::vector<float> tracer_masses;
+      for (int element : reduction.tracer_idx) {
+        tracer_masses.push_back(system.state.mass[element]);
+      }
+
+      hsize_t const tracer_DIMS[1] = {num_tracers};
+      hsize_t const tracer_position_DIMS[3] = {3, num_records, num_tracers};
+      DataSpace tracer_dataspace(1, tracer_DIMS);
+      DataSpace tracer_position_dataspace(3, tracer_position_DIMS);
+      reduced_group.createDataSet("tracer_index", PredType::NATIVE_INT, tracer_dataspace)
+          .write(reduction.tracer_idx.data(), PredType::NATIVE_INT);
+      reduced_group.createDataSet("tracer_masses", PredType::NATIVE_FLOAT, tracer_dataspace)
+          .write(tracer_masses.data(), PredType::NATIVE_FLOAT);
+      reduced_group.createDataSet("tracer_positions", PredType::NATIVE_FLOAT, tracer_position_dataspace)
+          .write(tracer_positions.data(), PredType::NATIVE_FLOAT);
+    }
+    reduced_group.close();
+  }
 
 
   out_file.close();
@@ -89,3 +226,61 @@ void output_results_HDF5(System system) {
   printf("Done. Time taken: %f seconds.\n", time_taken);
 }
 
+void output_ensemble_HDF5(Ensemble& ensemble) {
+  clock_t start_time, end_time;
+  double time_taken;
+
+  // Write every system to its own group (named like its initial conditions)
+  // with the same "positions" and "masses" datasets as a single system
+  std::string output_filename = "data/ensemble_results.hdf5";
+  printf("Writing results to %s\n", output_filename.c_str());
+  start_time = clock();
+
+  // Create a new file
+  H5File out_file(output_filename, H5F_ACC_TRUNC);
+
+  for (int system = 0; system < ensemble.num_systems; system++) {
+    const int num_elements = ensemble.num_elements(system);
+    const int offset = ensemble.offsets[system];
+    Group group = out_file.createGroup(ensemble.names[system]);
+
+    /********************** Position Data **********************/
+    hsize_t const position_DIMS[3] = {3,
+        static_cast<hsize_t>(ensemble.num_time_steps),
+        static_cast<hsize_t>(num_elements)};
+    DataSpace position_dataspace(3, position_DIMS);
+    DataSet position_dataset = group.createDataSet("positions",
+        PredType::NATIVE_FLOAT,
+        position_dataspace);
+
+    std::vector<float> positions(3 * ensemble.num_time_steps * num_elements);
+    for (int timestep = 0; timestep < ensemble.num_time_steps; timestep++) {
+      for (int element = 0; element < num_elements; element++) {
+        positions[(0 * ensemble.num_time_steps + timestep) * num_elements + element] = ensemble.x_history[timestep][offset + element];
+        positions[(1 * ensemble.num_time_steps + timestep) * num_elements + element] = ensemble.y_history[timestep][offset + element];
+        positions[(2 * ensemble.num_time_steps + timestep) * num_elements + element] = ensemble.z_history[timestep][offset + element];
+      }
+    }
+    position_dataset.write(positions.data(), PredType::NATIVE_FLOAT);
+    position_dataset.close();
+
+    /********************** Mass Data **********************/
+    hsize_t const mass_DIMS[1] = {static_cast<hsize_t>(num_elements)};
+    DataSpace mass_dataspace(1, mass_DIMS);
+    DataSet mass_dataset = group.createDataSet("masses",
+        PredType::NATIVE_FLOAT,
+        mass_dataspace);
+
+    std::vector<float> masses(ensemble.mass.begin() + offset, ensemble.mass.begin() + offset + num_elements);
+    mass_dataset.write(masses.data(), PredType::NATIVE_FLOAT);
+    mass_dataset.close();
+
+    group.close();
+  }
+
+  out_file.close();
+
+  end_time = clock();
+  time_taken = double(end_time - start_time) / double(CLOCKS_PER_SEC);
+  printf("Done. Time taken: %f seconds.\n", time_taken);
+}
@@ -0,0 +1,354 @@
+#include <iostream>
+#include <string>
+#include <chrono> // for timing (clock() adds up the time of every thread)
+#include <vector>
+#include <complex>
+#include <algorithm> // for std::max, std::min, std::fill
+#include <math.h> // for sqrt, erf, erfc, exp, floor
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/system.hpp"
+#include "include/pm.hpp"
+#include "include/fft.hpp"
+
+
+
+void System::solve_pm() {
+  if (this->num_time_steps > 1) {
+    printf("[PM] Solving for %d additional timesteps\n", this->num_time_steps-1);
+    auto start_time = std::chrono::steady_clock::now();
+
+    // Build the mesh and the (scale invariant) Green's function
+    this->initialize_pm();
+
+    // Record the initial energy and momentum (and the reduced output)
+    this->record_diagnostics(0);
+    this->record_reduction(0);
+
+    // Iterate over each subsequent timestep
+    for (int timestep = 1; timestep < this->num_time_steps; timestep++) {
+
+      // Initialize the velocities and positions of each element
+      // as the velocities and positions from the previous timestep.
+      this->propogate_state(timestep);
+
+      // Solve for and update the velocity of each element
+      // (long range on the mesh, short range between neighboring leaves)
+      this->update_velocity_pm(timestep);
+
+      // Solve for and update the position of each element
+      // (using the updated velocities calculated above)
+      this->interpolate_position(timestep);
+
+      // Record the energy and momentum (every diagnostic_interval timesteps)
+      // and the reduced output (every reduction_interval timesteps)
+      this->record_diagnostics(timestep);
+      this->record_reduction(timestep);
+    }
+
+    auto end_time = std::chrono::steady_clock::now();
+    const double time_taken = std::chrono::duration<double>(end_time - start_time).count();
+    printf("Done. Time taken: %f seconds.\n", time_taken);
+    this->print_diagnostics_summary();
+
+  } else {
+    printf("No additional timesteps to solve for.\n");
+  }
+  return;
+}
+
+
+PM_Grid::PM_Grid(int size, float split_scale) : size(size), padded_size(2 * size), split_scale(split_scale) {
+  const int n = this->padded_size;
+  this->density.resize(size * size * size);
+  this->potential.resize(size * size * size);
+
+  // Long-range kernel erf(r / 2r_s) / r (in grid units) on the padded grid,
+  // with distances wrapped so the circular convolution is isolated
+  std::vector<float> kernel(n * n * n);
+  #pragma omp parallel for schedule(static)
+  for (int iz = 0; iz < n; iz++) {
+    for (int iy = 0; iy < n; iy++) {
+      for (int ix = 0; ix < n; ix++) {
+        const int dx = std::min(ix, n - ix);
+        const int dy = std::min(iy, n - iy);
+        const int dz = std::min(iz, n - iz);
+        const double r = sqrt(dx*dx + dy*dy + dz*dz);
+        // (the limit at r = 0 is 1 / (r_s sqrt(pi)))
+        const double value = (r > 0) ? erf(r / (2 * split_scale)) / r : 1.0 / (split_scale * sqrt(M_PI));
+        kernel[ix + n * (iy + n * iz)] = value;
+      }
+    }
+  }
+  fft_3d_real_forward(kernel, n, n, this->spectrum);
+
+  // The kernel is real and even, so its transform is real
+  this->green.resize(this->spectrum.size());
+  for (int i = 0; i < (int) this->spectrum.size(); i++) {
+    this->green[i] = this->spectrum[i].real();
+  }
+}
+
+void System::initialize_pm() {
+  // The FFT needs a power of 2
+  int size = 8;
+  while (size < this->pm_grid_size) {
+    size *= 2;
+  }
+  if (size != this->pm_grid_size) {
+    printf("PM grid size rounded up to %d\n", size);
+    this->pm_grid_size = size;
+  }
+
+  // The short-range sum only looks at neighboring leaves, so the leaves
+  // must be at least the cutoff (PM_CUTOFF * r_s) wide: the tree is made
+  // as deep as that allows (deeper leaves hold fewer pairs to sum).
+  // The leaves are at least at layer 1 (the base block holds no elements)
+  float split_scale = this->pm_split_scale;
+  if (this->pm_short_range) {
+    const float domain_width = size - 2 * PM_MARGIN - 1;  // in grid spacings
+    if (PM_CUTOFF * split_scale > domain_width / 2) {
+      // (only for grids too small for the split)
+      split_scale = domain_width / (2 * PM_CUTOFF);
+      printf("Warning: PM grid of %d too small for a split scale of %f, reduced to %f grid spacings\n",
+          size, this->pm_split_scale, split_scale);
+    }
+    int depth = 1;
+    while (domain_width / (1 << (depth + 1)) >= PM_CUTOFF * split_scale) {
+      depth++;
+    }
+    if (depth != this->tree_depth) {
+      printf("PM leaves sized to the cutoff, tree depth set to %d\n", depth);
+      this->tree_depth = depth;
+    }
+  }
+  this->build_tree();
+
+  if (this->pm_grid.size != size || this->pm_grid.split_scale != split_scale) {
+    this->pm_grid = PM_Grid(size, split_scale);
+  }
+}
+
+// Nodes and weights of the mass assignment of a coordinate u (in grid units).
+// Returns the number of nodes (2 for CIC, 3 for TSC), starting at *first.
+static int assignment_weights(float u, bool use_tsc, int* first, float weights[3]) {
+  if (use_tsc) {
+    // Triangular shaped cloud
+    const int nearest = (int) floor(u + 0.5f);
+    const float d = u - nearest;
+    *first = nearest - 1;
+    weights[0] = 0.5f * (0.5f - d) * (0.5f - d);
+    weights[1] = 0.75f - d * d;
+    weights[2] = 0.5f * (0.5f + d) * (0.5f + d);
+    return 3;
+  }
+  // Cloud in cell
+  const int lower = (int) floor(u);
+  *first = lower;
+  weights[1] = u - lower;
+  weights[0] = 1 - weights[1];
+  return 2;
+}
+
+void System::update_velocity_pm(int curr_timestep) {
+  // The cubic domain and the leaves (for the short-range sum)
+  this->decompose_domain_fmm(curr_timestep);
+
+  // Fit the grid to the domain (with PM_MARGIN empty nodes on each side)
+  PM_Grid& grid = this->pm_grid;
+  grid.spacing = (this->base_block.x_max - this->base_block.x_min) / (grid.size - 2 * PM_MARGIN - 1);
+  grid.origin_x = this->base_block.x_min - PM_MARGIN * grid.spacing;
+  grid.origin_y = this->base_block.y_min - PM_MARGIN * grid.spacing;
+  grid.origin_z = this->base_block.z_min - PM_MARGIN * grid.spacing;
+
+  this->deposit_mass_pm(curr_timestep);
+  this->solve_potential_pm();
+  this->interpolate_field_pm(curr_timestep);
+  if (this->pm_short_range) {
+    this->short_range_pm(curr_timestep);
+  }
+}
+
+void System::deposit_mass_pm(int curr_timestep) {
+  PM_Grid& grid = this->pm_grid;
+  std::fill(grid.density.begin(), grid.density.end(), 0.0f);
+
+  // Sort the elements into slabs of PM_SLAB_WIDTH z planes (by the first
+  // plane they are assigned to)
+  const int num_slabs = (grid.size + PM_SLAB_WIDTH - 1) / PM_SLAB_WIDTH;
+  std::vector<int> slab(this->num_elements);
+  #pragma omp parallel for schedule(static)
+  for (int element = 0; element < this->num_elements; element++) {
+    int first_z;
+    float wz[3];
+    assignment_weights((this->state.z[curr_timestep][element] - grid.origin_z) / grid.spacing, this->pm_use_tsc, &first_z, wz);
+    slab[element] = first_z / PM_SLAB_WIDTH;
+  }
+  grid.slab_start.assign(num_slabs + 1, 0);
+  for (int element = 0; element < this->num_elements; element++) {
+    grid.slab_start[slab[element] + 1]++;
+  }
+  for (int s = 0; s < num_slabs; s++) {
+    grid.slab_start[s + 1] += grid.slab_start[s];
+  }
+  grid.slab_elements.resize(this->num_elements);
+  std::vector<int> next(grid.slab_start.begin(), grid.slab_start.end() - 1);
+  for (int element = 0; element < this->num_elements; element++) {
+    grid.slab_elements[next[slab[element]]++] = element;
+  }
+
+  // Even slabs in parallel, then odd slabs
+  // (no two slabs of a pass touch the same node, see PM_SLAB_WIDTH)
+  for (int parity = 0; parity < 2; parity++) {
+    #pragma omp parallel for schedule(dynamic)
+    for (int s = parity; s < num_slabs; s += 2) {
+      int first_x, first_y, first_z;
+      float wx[3], wy[3], wz[3];
+      for (int idx = grid.slab_start[s]; idx < grid.slab_start[s + 1]; idx++) {
+        const int element = grid.slab_elements[idx];
+        const int count = assignment_weights((this->state.x[curr_timestep][element] - grid.origin_x) / grid.spacing, this->pm_use_tsc, &first_x, wx);
+        assignment_weights((this->state.y[curr_timestep][element] - grid.origin_y) / grid.spacing, this->pm_use_tsc, &first_y, wy);
+        assignment_weights((this->state.z[curr_timestep][element] - grid.origin_z) / grid.spacing, this->pm_use_tsc, &first_z, wz);
+        const float mass = this->state.mass[element];
+
+        for (int k = 0; k < count; k++) {
+          for (int j = 0; j < count; j++) {
+            for (int i = 0; i < count; i++) {
+              grid.density[grid.node_index(first_x + i, first_y + j, first_z + k)] += mass * wx[i] * wy[j] * wz[k];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void System::solve_potential_pm() {
+  PM_Grid& grid = this->pm_grid;
+  const int n = grid.padded_size;
+
+  // Convolve the mass with the kernel
+  // (real transforms of the zero padded density, see fft.hpp)
+  fft_3d_real_forward(grid.density, n, grid.size, grid.spectrum);
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < (int) grid.spectrum.size(); i++) {
+    grid.spectrum[i] *= grid.green[i];
+  }
+  fft_3d_real_inverse(grid.spectrum, n, grid.size, grid.potential);
+
+  // Normalize the FFT and scale the kernel from grid units to the actual spacing
+  const float scale = 1.0 / ((double) n * n * n * grid.spacing);
+  #pragma omp parallel for schedule(static)
+  for (int node = 0; node < (int) grid.potential.size(); node++) {
+    grid.potential[node] *= scale;
+  }
+}
+
+void System::interpolate_field_pm(int curr_timestep) {
+  const PM_Grid& grid = this->pm_grid;
+  const float adjusted_constant = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR;
+  const std::vector<float>& potential = grid.potential;
+  const int stride_y = grid.size;
+  const int stride_z = grid.size * grid.size;
+  const float scale = adjusted_constant / (12 * grid.spacing);
+
+  // (each thread updates the velocities of its own static share of the elements)
+  #pragma omp parallel for schedule(static)
+  for (int element = 0; element < this->num_elements; element++) {
+    int first_x, first_y, first_z;
+    float wx[3], wy[3], wz[3];
+    const int count = assignment_weights((this->state.x[curr_timestep][element] - grid.origin_x) / grid.spacing, this->pm_use_tsc, &first_x, wx);
+    assignment_weights((this->state.y[curr_timestep][element] - grid.origin_y) / grid.spacing, this->pm_use_tsc, &first_y, wy);
+    assignment_weights((this->state.z[curr_timestep][element] - grid.origin_z) / grid.spacing, this->pm_use_tsc, &first_z, wz);
+
+    // Interpolate the gradient of the potential (4-point differences at
+    // each node) with the same weights used to assign the mass
+    float field_x = 0, field_y = 0, field_z = 0;
+    for (int k = 0; k < count; k++) {
+      for (int j = 0; j < count; j++) {
+        for (int i = 0; i < count; i++) {
+          const int node = grid.node_index(first_x + i, first_y + j, first_z + k);
+          const float weight = wx[i] * wy[j] * wz[k];
+          field_x += weight * (8 * (potential[node + 1] - potential[node - 1]) - (potential[node + 2] - potential[node - 2]));
+          field_y += weight * (8 * (potential[node + stride_y] - potential[node - stride_y]) - (potential[node + 2 * stride_y] - potential[node - 2 * stride_y]));
+          field_z += weight * (8 * (potential[node + stride_z] - potential[node - stride_z]) - (potential[node + 2 * stride_z] - potential[node - 2 * stride_z]));
+        }
+      }
+    }
+
+    // update element velocity
+    this->state.vx[curr_timestep][element] += scale * field_x * this->actual_delta_t;
+    this->state.vy[curr_timestep][element] += scale * field_y * this->actual_delta_t;
+    this->state.vz[curr_timestep][element] += scale * field_z * this->actual_delta_t;
+  }
+}
+
+void System::short_range_pm(int curr_timestep) {
+  const float adjusted_constant = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR;
+  const float split = this->pm_grid.split_scale * this->pm_grid.spacing;  // r_s
+  const float cutoff_squared = (PM_CUTOFF * split) * (PM_CUTOFF * split);
+
+  // Walk the leaves the same way as the FMM near field
+  std::vector<Block*> leaves;
+  std::vector<Block*> stack = {&this->base_block};
+  while (!stack.empty()) {
+    Block* block = stack.back();
+    stack.pop_back();
+    if (block->layer == this->tree_depth) {
+      leaves.push_back(block);
+    } else {
+      for (Block& child : block->children) {
+        stack.push_back(&child);
+      }
+    }
+  }
+  const int side = 1 << this->tree_depth;
+  std::vector<Block*> grid_leaves(side * side * side);
+  for (Block* leaf : leaves) {
+    grid_leaves[leaf->ix + side * (leaf->iy + side * leaf->iz)] = leaf;
+  }
+
+  // Each thread takes leaves as it goes (they hold very different numbers
+  // of elements), and only updates the velocities of their elements
+  #pragma omp parallel for schedule(dynamic)
+  for (int leaf = 0; leaf < (int) leaves.size(); leaf++) {
+    const Block* block = leaves[leaf];
+    for (int element : block->element_idx) {
+      const float x = this->state.x[curr_timestep][element];
+      const float y = this->state.y[curr_timestep][element];
+      const float z = this->state.z[curr_timestep][element];
+      float field_x = 0, field_y = 0, field_z = 0;
+
+      // The remainder (short-range part) of the force from every element
+      // of this leaf and its neighbors within the cutoff
+      for (int jz = std::max(block->iz - 1, 0); jz <= std::min(block->iz + 1, side - 1); jz++) {
+        for (int jy = std::max(block->iy - 1, 0); jy <= std::min(block->iy + 1, side - 1); jy++) {
+          for (int jx = std::max(block->ix - 1, 0); jx <= std::min(block->ix + 1, side - 1); jx++) {
+            for (int other : grid_leaves[jx + side * (jy + side * jz)]->element_idx) {
+              const float dx = this->state.x[curr_timestep][other] - x;
+              const float dy = this->state.y[curr_timestep][other] - y;
+              const float dz = this->state.z[curr_timestep][other] - z;
+              const float r_squared = dx*dx + dy*dy + dz*dz;
+              if (r_squared == 0 || r_squared > cutoff_squared) {
+                continue;  // (includes the element itself)
+              }
+              const float r = sqrt(r_squared);
+              const float u = r / (2 * split);
+              const float factor = erfc(u) + 2 * u / sqrt(M_PI) * exp(-u * u);
+              const float weight = this->state.mass[other] * factor / (r_squared * r);
+              field_x += weight * dx;
+              field_y += weight * dy;
+              field_z += weight * dz;
+            }
+          }
+        }
+      }
+
+      // update element velocity
+      this->state.vx[curr_timestep][element] += adjusted_constant * field_x * this->actual_delta_t;
+      this->state.vy[curr_timestep][element] += adjusted_constant * field_y * this->actual_delta_t;
+      this->state.vz[curr_timestep][element] += adjusted_constant * field_z * this->actual_delta_t;
+    }
+  }
+}
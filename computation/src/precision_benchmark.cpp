@@ -0,0 +1,61 @@
+/* Benchmark of the direct solver precision policies.
+   Runs the same system with each policy and reports the throughput
+   and the relative drift of the total energy. */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono> // for timing
+#include <stdlib.h> // for atoi, rand
+#include <math.h> // for sqrt, cos, sin, fabs
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/precision.hpp"
+#include "include/system.hpp"
+
+
+int main(int argc, char *argv[]) {
+  // Usage: Precision_Benchmark_exe [num_elements] [num_time_steps]
+  const int num_elements = (argc > 1) ? atoi(argv[1]) : 1024;
+  const int num_time_steps = (argc > 2) ? atoi(argv[2]) : 100;
+  printf("Precision benchmark: %d elements, %d timesteps, real_t is %s\n",
+      num_elements, num_time_steps, (sizeof(real_t) == sizeof(double)) ? "double" : "float");
+
+  // A heavy central mass (G * M = 1) with light elements on circular orbits
+  std::vector<float> ic_data(num_elements * NUM_VALUES);
+  ic_data[6] = 1e7;
+  for (int i = 1; i < num_elements; i++) {
+    const float radius = 0.5 + 2.5 * (rand() % 1000) / 1000.0;
+    const float angle = 2 * M_PI * (rand() % 1000) / 1000.0;
+    const float speed = 1.0 / sqrt(radius);
+    float* element = &ic_data[i * NUM_VALUES];
+    element[0] = radius * cos(angle);
+    element[1] = radius * sin(angle);
+    element[2] = 0.01 * ((rand() % 1000) / 500.0 - 1);
+    element[3] = -speed * sin(angle);
+    element[4] = speed * cos(angle);
+    element[5] = 0;
+    element[6] = DEFAULT_MASS;
+  }
+
+  const Precision_Policy policies[] = {PRECISION_FLOAT, PRECISION_MIXED, PRECISION_KAHAN, PRECISION_DOUBLE};
+  const char* policy_names[] = {Float_Precision::name, Mixed_Precision::name, Kahan_Precision::name, Double_Precision::name};
+
+  for (int policy = 0; policy < 4; policy++) {
+    System system(reinterpret_cast<float(*)[NUM_VALUES]>(ic_data.data()), num_elements, num_time_steps, 1.0);
+    system.precision_policy = policies[policy];
+    system.diagnostic_interval = num_time_steps - 1;  // only the first and last steps
+
+    auto start_time = std::chrono::steady_clock::now();
+    system.solve_direct();
+    auto end_time = std::chrono::steady_clock::now();
+    const double time_taken = std::chrono::duration<double>(end_time - start_time).count();
+
+    const double interactions = (double) num_elements * (num_elements - 1) * (num_time_steps - 1);
+    printf("[%-6s] %f seconds, %f G interactions/s, energy drift %e\n",
+        policy_names[policy], time_taken, interactions * 1e-9 / time_taken,
+        fabs(system.diagnostics.energy_drift()));
+  }
+  return 0;
+}
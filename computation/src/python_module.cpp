@@ -0,0 +1,197 @@
+/* Python module of the solver (built when pybind11 is found).
+   The state arrays are returned as NumPy views of the System's own memory
+   (no copies), and the solve can be stepped from Python
+   (with output="reduced" only the current and previous timesteps are
+   kept, and they are returned as copies):
+
+     import numpy as np, nbody_solver
+     ic = nbody_solver.read_initial_conditions("data/initial_conditions.hdf5")
+     system = nbody_solver.System(ic, num_time_steps=200, delta_t=1.0)
+     system.start("fmm")
+     while system.step():
+       x, y, z = system.positions(system.current_timestep)
+*/
+
+#include <string>
+#include <vector>
+#include <stdexcept> // for std::invalid_argument
+#include <algorithm> // for std::copy
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/system.hpp"
+
+namespace py = pybind11;
+
+
+static Solver_Type parse_solver(const std::string& name) {
+  if (name == "direct") {
+    return SOLVER_DIRECT;
+  } else if (name == "fmm") {
+    return SOLVER_FMM;
+  } else if (name == "pm") {
+    return SOLVER_PM;
+  }
+  throw std::invalid_argument("unknown solver '" + name + "' (direct, fmm or pm)");
+}
+
+// View of one state array
+// (owner keeps the System alive for as long as the view exists)
+template <typename Vector>
+static py::array_t<real_t> state_view(Vector& values, py::handle owner) {
+  return py::array_t<real_t>({(py::ssize_t) values.size()}, {(py::ssize_t) sizeof(real_t)}, values.data(), owner);
+}
+
+// Array of one timestep of the state: a view, or a copy for the reduced
+// output, whose slots are reused by later timesteps (see State_History)
+// and would change under a view two steps later
+template <typename Vector>
+static py::array_t<real_t> state_array(const System& system, Vector& values, py::handle owner) {
+  if (system.state.num_slots < system.num_time_steps) {
+    return py::array_t<real_t>((py::ssize_t) values.size(), values.data());
+  }
+  return state_view(values, owner);
+}
+
+static int checked_timestep(const System& system, int timestep) {
+  // (negative timesteps count from the end, like Python indices)
+  if (timestep < 0) {
+    timestep += system.num_time_steps;
+  }
+  if (timestep < 0 || timestep >= system.num_time_steps) {
+    throw py::index_error("timestep out of range");
+  }
+  // (the reduced output only keeps the latest timesteps, see State_History)
+  if (system.state.num_slots < system.num_time_steps && !system.state.keeps(timestep, system.current_timestep)) {
+    throw py::index_error("timestep not kept by the reduced output (only the current and previous ones are)");
+  }
+  return timestep;
+}
+
+// The tree and the mesh are sized from the settings when the solver starts,
+// so a setting changed after start() rebuilds them before the next step
+// (instead of the next step running on buffers of the old size)
+static void reinitialize_solver(System& system) {
+  if (system.current_timestep < 0) {
+    return;
+  }
+  if (system.solver_type == SOLVER_FMM) {
+    system.initialize_fmm();
+  } else if (system.solver_type == SOLVER_PM) {
+    system.initialize_pm();
+  }
+}
+
+
+PYBIND11_MODULE(nbody_solver, module) {
+  module.doc() = "N-body solver (direct, FMM and PM) with zero-copy NumPy views of the state";
+
+  module.def("read_initial_conditions", [](std::string input_filename) {
+    std::vector<float> ic_buffer = read_initial_conditions_HDF5(input_filename);
+    py::array_t<float> ic_data({(py::ssize_t) ic_buffer.size() / NUM_VALUES, (py::ssize_t) NUM_VALUES});
+    std::copy(ic_buffer.begin(), ic_buffer.end(), ic_data.mutable_data());
+    return ic_data;
+  }, py::arg("input_filename"),
+  "Reads an initial conditions file into an (N, 7) array (x, y, z, vx, vy, vz, mass)");
+
+  py::class_<System>(module, "System")
+    .def(py::init([](py::array_t<float, py::array::c_style | py::array::forcecast> ic_data, int num_time_steps, float delta_t, std::string output) {
+      if (ic_data.ndim() != 2 || ic_data.shape(1) != NUM_VALUES) {
+        throw std::invalid_argument("initial conditions must be an (N, 7) array");
+      }
+      if (output != "full" && output != "reduced") {
+        throw std::invalid_argument("unknown output '" + output + "' (full or reduced)");
+      }
+      // (the System copies the initial conditions into its own state)
+      float (*ic)[NUM_VALUES] = reinterpret_cast<float(*)[NUM_VALUES]>(const_cast<float*>(ic_data.data()));
+      return new System(ic, ic_data.shape(0), num_time_steps, delta_t, (output == "reduced") ? OUTPUT_REDUCED : OUTPUT_FULL);
+    }), py::arg("ic_data"), py::arg("num_time_steps") = 200, py::arg("delta_t") = 1.0, py::arg("output") = "full")
+
+    .def_readonly("num_elements", &System::num_elements)
+    .def_readonly("num_time_steps", &System::num_time_steps)
+    .def_readonly("current_timestep", &System::current_timestep)
+    .def_property("tree_depth", [](const System& system) { return system.tree_depth; },
+      [](System& system, int tree_depth) {
+        if (tree_depth < FMM_MIN_DEPTH || tree_depth > FMM_MAX_DEPTH) {
+          throw py::value_error("tree_depth must be between " + std::to_string(FMM_MIN_DEPTH) + " and " + std::to_string(FMM_MAX_DEPTH));
+        }
+        system.tree_depth = tree_depth;
+        reinitialize_solver(system);
+      }, "Depth of the tree (the PM solver sizes its own leaves)")
+    .def_property("fmm_order", [](const System& system) { return system.fmm_order; },
+      [](System& system, int fmm_order) {
+        if (fmm_order < FMM_MIN_ORDER || fmm_order > FMM_MAX_ORDER) {
+          throw py::value_error("fmm_order must be between " + std::to_string(FMM_MIN_ORDER) + " and " + std::to_string(FMM_MAX_ORDER));
+        }
+        system.fmm_order = fmm_order;
+        reinitialize_solver(system);
+      })
+    .def_property("pm_grid_size", [](const System& system) { return system.pm_grid_size; },
+      [](System& system, int pm_grid_size) {
+        system.pm_grid_size = pm_grid_size;
+        reinitialize_solver(system);
+      })
+    .def_property("pm_split_scale", [](const System& system) { return system.pm_split_scale; },
+      [](System& system, float pm_split_scale) {
+        system.pm_split_scale = pm_split_scale;
+        reinitialize_solver(system);
+      }, "r_s of the PM force split, in grid spacings")
+    .def_readwrite("diagnostic_interval", &System::diagnostic_interval)
+
+    // Stepping
+    .def("start", [](System& system, std::string solver) {
+      system.start_solver(parse_solver(solver));
+    }, py::arg("solver") = "direct", "Sets up the solver (direct, fmm or pm) at timestep 0")
+    .def("step", [](System& system) {
+      // (the solver loops are OpenMP, so Python threads can run meanwhile)
+      py::gil_scoped_release release;
+      return system.step();
+    }, "Solves the next timestep, returns False once the last one is solved")
+    .def("solve", [](System& system, std::string solver) {
+      const Solver_Type solver_type = parse_solver(solver);
+      py::gil_scoped_release release;
+      system.start_solver(solver_type);
+      while (system.step()) {
+      }
+    }, py::arg("solver") = "direct", "Solves every timestep")
+
+    // Zero-copy views of the state (writable, so the state can be edited in place)
+    .def("positions", [](py::object self, int timestep) {
+      System& system = self.cast<System&>();
+      timestep = checked_timestep(system, timestep);
+      return py::make_tuple(state_array(system, system.state.x[timestep], self),
+                            state_array(system, system.state.y[timestep], self),
+                            state_array(system, system.state.z[timestep], self));
+    }, py::arg("timestep"), "(x, y, z) arrays of the timestep, viewing the solver's memory (copies with output='reduced')")
+    .def("velocities", [](py::object self, int timestep) {
+      System& system = self.cast<System&>();
+      timestep = checked_timestep(system, timestep);
+      return py::make_tuple(state_array(system, system.state.vx[timestep], self),
+                            state_array(system, system.state.vy[timestep], self),
+                            state_array(system, system.state.vz[timestep], self));
+    }, py::arg("timestep"), "(vx, vy, vz) arrays of the timestep, viewing the solver's memory (copies with output='reduced')")
+    .def("masses", [](py::object self) {
+      System& system = self.cast<System&>();
+      return state_view(system.state.mass, self);
+    }, "Mass array, viewing the solver's memory")
+
+    // Diagnostics (small, so these are copies)
+    .def("diagnostics", [](System& system) {
+      const Diagnostics_Data& diagnostics = system.diagnostics;
+      py::dict result;
+      result["timestep"] = diagnostics.timestep;
+      result["kinetic_energy"] = diagnostics.kinetic_energy;
+      result["potential_energy"] = diagnostics.potential_energy;
+      result["total_energy"] = diagnostics.total_energy;
+      result["momentum"] = diagnostics.momentum;
+      result["angular_momentum"] = diagnostics.angular_momentum;
+      return result;
+    }, "Energy and momentum records of the solve so far")
+
+    .def("write_results", [](System& system, std::string output_filename) {
+      output_results_HDF5(system, output_filename);
+    }, py::arg("output_filename") = "data/results.hdf5", "Writes the results like Solver_exe");
+}
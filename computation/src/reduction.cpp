@@ -0,0 +1,123 @@
+/* This file holds the in-situ reduction of the state
+   (projected density images, 3D density grid and tracer trajectories)
+   written by the reduced output mode instead of the full trajectories. */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm> // for std::min, std::max
+#include <math.h> // for floor
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/system.hpp"
+
+
+void System::select_tracers(int num_tracers) {
+  // Evenly spaced elements (the same ones for every run of the same input)
+  num_tracers = std::max(0, std::min(num_tracers, this->num_elements));
+  this->reduction.tracer_idx.clear();
+  for (int tracer = 0; tracer < num_tracers; tracer++) {
+    this->reduction.tracer_idx.push_back((long) tracer * this->num_elements / num_tracers);
+  }
+}
+
+// Cell of a coordinate along one axis (-1 if outside of [min, max))
+static int bin_index(float value, float min, float max, int num_bins) {
+  const int bin = floor((value - min) / (max - min) * num_bins);
+  return (bin >= 0 && bin < num_bins) ? bin : -1;
+}
+
+void System::record_reduction(int curr_timestep) {
+  // Only the reduced output needs it, every reduction_interval timesteps (and the last one)
+  if (this->output_mode != OUTPUT_REDUCED || this->reduction_interval <= 0) {
+    return;
+  }
+  if (curr_timestep % this->reduction_interval != 0 && curr_timestep != this->num_time_steps - 1) {
+    return;
+  }
+  const State_History& x = this->state.x;
+  const State_History& y = this->state.y;
+  const State_History& z = this->state.z;
+  Reduction_Data& reduction = this->reduction;
+
+  // The first record fixes the sizes, the tracers and the imaged region
+  // (a cube around the initial bounding box, the same for every record)
+  if (reduction.num_records() == 0) {
+    reduction.image_size = REDUCTION_IMAGE_SIZE;
+    reduction.grid_size = REDUCTION_GRID_SIZE;
+    if (reduction.tracer_idx.empty()) {
+      this->select_tracers(REDUCTION_NUM_TRACERS);
+    }
+
+    float x_min = x[curr_timestep][0], x_max = x_min;
+    float y_min = y[curr_timestep][0], y_max = y_min;
+    float z_min = z[curr_timestep][0], z_max = z_min;
+    for (int element = 1; element < this->num_elements; element++) {
+      x_min = std::min(x_min, (float) x[curr_timestep][element]);
+      x_max = std::max(x_max, (float) x[curr_timestep][element]);
+      y_min = std::min(y_min, (float) y[curr_timestep][element]);
+      y_max = std::max(y_max, (float) y[curr_timestep][element]);
+      z_min = std::min(z_min, (float) z[curr_timestep][element]);
+      z_max = std::max(z_max, (float) z[curr_timestep][element]);
+    }
+    float half_width = std::max(x_max - x_min, std::max(y_max - y_min, z_max - z_min)) / 2 * REDUCTION_EXTENT_SCALE;
+    if (half_width <= 0) {
+      half_width = 1;
+    }
+    const float mid[3] = {(x_min + x_max) / 2, (y_min + y_max) / 2, (z_min + z_max) / 2};
+    for (int axis = 0; axis < 3; axis++) {
+      reduction.extent[2 * axis] = mid[axis] - half_width;
+      reduction.extent[2 * axis + 1] = mid[axis] + half_width;
+    }
+  }
+
+  const int image_size = reduction.image_size;
+  const int grid_size = reduction.grid_size;
+  const float* extent = reduction.extent;
+
+  // New (empty) record
+  const int record = reduction.num_records();
+  reduction.timestep.push_back(curr_timestep);
+  reduction.projection_xy.resize((record + 1) * image_size * image_size);
+  reduction.projection_xz.resize((record + 1) * image_size * image_size);
+  reduction.projection_yz.resize((record + 1) * image_size * image_size);
+  reduction.density_grid.resize((record + 1) * grid_size * grid_size * grid_size);
+  float* projection_xy = &reduction.projection_xy[record * image_size * image_size];
+  float* projection_xz = &reduction.projection_xz[record * image_size * image_size];
+  float* projection_yz = &reduction.projection_yz[record * image_size * image_size];
+  float* density_grid = &reduction.density_grid[record * grid_size * grid_size * grid_size];
+
+  // Bin the mass of every element (nearest pixel/cell)
+  double mass_outside = 0;
+  for (int element = 0; element < this->num_elements; element++) {
+    const float mass = this->state.mass[element];
+    const int px = bin_index(x[curr_timestep][element], extent[0], extent[1], image_size);
+    const int py = bin_index(y[curr_timestep][element], extent[2], extent[3], image_size);
+    const int pz = bin_index(z[curr_timestep][element], extent[4], extent[5], image_size);
+    if (px < 0 || py < 0 || pz < 0) {
+      mass_outside += mass;
+      continue;
+    }
+    projection_xy[py * image_size + px] += mass;
+    projection_xz[pz * image_size + px] += mass;
+    projection_yz[pz * image_size + py] += mass;
+
+    if (grid_size > 0) {
+      const int gx = bin_index(x[curr_timestep][element], extent[0], extent[1], grid_size);
+      const int gy = bin_index(y[curr_timestep][element], extent[2], extent[3], grid_size);
+      const int gz = bin_index(z[curr_timestep][element], extent[4], extent[5], grid_size);
+      if (gx >= 0 && gy >= 0 && gz >= 0) {
+        density_grid[gx + grid_size * (gy + grid_size * gz)] += mass;
+      }
+    }
+  }
+  reduction.mass_outside.push_back(mass_outside);
+
+  // Full trajectories of the tracers only
+  for (int element : reduction.tracer_idx) {
+    reduction.tracer_x.push_back(x[curr_timestep][element]);
+    reduction.tracer_y.push_back(y[curr_timestep][element]);
+    reduction.tracer_z.push_back(z[curr_timestep][element]);
+  }
+}
@@ -0,0 +1,63 @@
+/* This file holds the stepping interface of System: the same timesteps as
+   solve_direct, solve_fmm and solve_pm, but one per call, so an embedding
+   program can look at (or change) the state in between. */
+
+#include <iostream>
+#include <string>
+
+#include "include/parameters.hpp"
+#include "include/declarations.hpp"
+#include "include/system.hpp"
+
+
+void System::start_solver(Solver_Type solver) {
+  this->solver_type = solver;
+
+  // Same setup as the solve functions
+  if (solver == SOLVER_FMM) {
+    this->initialize_fmm();
+  } else if (solver == SOLVER_PM) {
+    this->initialize_pm();
+  }
+
+  // Record the initial energy and momentum (and the reduced output)
+  this->record_diagnostics(0);
+  this->record_reduction(0);
+  this->current_timestep = 0;
+}
+
+bool System::step() {
+  // Nothing left once the last timestep is solved
+  if (this->current_timestep < 0 || this->current_timestep + 1 >= this->num_time_steps) {
+    return false;
+  }
+  const int timestep = ++this->current_timestep;
+
+  // Initialize the velocities and positions of each element
+  // as the velocities and positions from the previous timestep.
+  this->propogate_state(timestep);
+
+  // Solve for and update the velocity of each element
+  switch (this->solver_type) {
+    case SOLVER_DIRECT:
+      this->update_velocity_direct(timestep);
+      break;
+    case SOLVER_FMM:
+      this->decompose_domain_fmm(timestep);
+      this->solve_time_step_fmm(timestep);
+      break;
+    case SOLVER_PM:
+      this->update_velocity_pm(timestep);
+      break;
+  }
+
+  // Solve for and update the position of each element
+  // (using the updated velocities calculated above)
+  this->interpolate_position(timestep);
+
+  // Record the energy and momentum (every diagnostic_interval timesteps)
+  // and the reduced output (every reduction_interval timesteps)
+  this->record_diagnostics(timestep);
+  this->record_reduction(timestep);
+  return true;
+}
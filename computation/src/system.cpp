@@ -2,7 +2,7 @@
 #include <string>
 #include <H5Cpp.h>
 #include <time.h> // for timing
-#include <algorithm> // for std::copy
+#include <algorithm> // for std::copy, std::min
 #include <vector>
 #include <math.h> // for sqrt
 
@@ -11,8 +11,8 @@
 #include "include/system.hpp"
 
 
-System::System(float ic_data[][NUM_VALUES], const int num_elements, const int num_time_steps, const float delta_t)
-  : num_elements(num_elements), num_time_steps(num_time_steps), delta_t(delta_t), actual_delta_t(0), state(num_time_steps, num_elements), base_block() {
+System::System(float ic_data[][NUM_VALUES], const int num_elements, const int num_time_steps, const float delta_t, const Output_Mode output_mode)
+  : num_elements(num_elements), num_time_steps(num_time_steps), delta_t(delta_t), actual_delta_t(0), state((output_mode == OUTPUT_REDUCED) ? std::min(2, num_time_steps) : num_time_steps, num_elements), precision_policy(DEFAULT_PRECISION_POLICY), direct_tile_size(DIRECT_TILE_SIZE), base_block(), tree_depth(NUM_LAYERS), fmm_order(FMM_ORDER), pm_grid_size(PM_GRID_SIZE), pm_use_tsc(PM_USE_TSC), pm_short_range(PM_SHORT_RANGE), pm_split_scale(PM_SPLIT_SCALE), diagnostic_interval(DIAGNOSTIC_INTERVAL), solver_type(SOLVER_DIRECT), current_timestep(-1), output_mode(output_mode), reduction_interval(REDUCTION_INTERVAL) {
   // printf("System constructor inside\n");
   this->actual_delta_t = delta_t * TIME_SCALING_FACTOR;
 
@@ -37,6 +37,8 @@ System::~System() {
 
 void System::interpolate_position(int curr_timestep) {
   // iterate over each element
+  // (static, the same partition the state arrays were first touched with)
+  #pragma omp parallel for schedule(static)
   for (int element = 0; element < this->num_elements; element++) {
     
     // Advance the position by the velocity times delta_t
@@ -54,6 +56,8 @@ void System::interpolate_position(int curr_timestep) {
 
 void System::propogate_state(int curr_timestep) {
   // iterate over each element
+  // (static, the same partition the state arrays were first touched with)
+  #pragma omp parallel for schedule(static)
   for (int element = 0; element < this->num_elements; element++) {
     // Directly copy the position from the previous timestep
     this->state.x[curr_timestep][element] = 
@@ -73,7 +77,7 @@ void System::propogate_state(int curr_timestep) {
   }
 }
 
-void System::Calculate_Gravitational_Force(float pos_x1, float pos_x2, float pos_y1, float pos_y2, float pos_z1, float pos_z2, float mass1, float mass2, float* force_x, float* force_y, float* force_z) {
+void System::Calculate_Gravitational_Force(real_t pos_x1, real_t pos_x2, real_t pos_y1, real_t pos_y2, real_t pos_z1, real_t pos_z2, real_t mass1, real_t mass2, real_t* force_x, real_t* force_y, real_t* force_z) {
   // Calculate the gravitational force between two elements
   // using the formula:
   // F = G * m1 * m2 / r^2
@@ -83,24 +87,24 @@ void System::Calculate_Gravitational_Force(float pos_x1, float pos_x2, float pos
 
   // Use the scaling factors to adjust force calculation
   // m^3 kg^-1 s^-2
-  // const float adjusted_constant = GRAVITATIONAL_CONSTANT * MASS_SCALING_FACTOR * MASS_SCALING_FACTOR / (DISTANCE_SCALING_FACTOR * DISTANCE_SCALING_FACTOR);
+  // const real_t adjusted_constant = GRAVITATIONAL_CONSTANT * MASS_SCALING_FACTOR * MASS_SCALING_FACTOR / (DISTANCE_SCALING_FACTOR * DISTANCE_SCALING_FACTOR);
 
-  const float adjusted_constant = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR;
+  const real_t adjusted_constant = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR;
 
 
 
   // printf("Adjusted constant: %f\n", adjusted_constant);
 
   // Calculate distances between the elements
-  const float dx = pos_x1 - pos_x2;
-  const float dy = pos_y1 - pos_y2;
-  const float dz = pos_z1 - pos_z2;
-  const float r_squared = dx*dx + dy*dy + dz*dz;
-  const float r = sqrt(r_squared);
+  const real_t dx = pos_x1 - pos_x2;
+  const real_t dy = pos_y1 - pos_y2;
+  const real_t dz = pos_z1 - pos_z2;
+  const real_t r_squared = dx*dx + dy*dy + dz*dz;
+  const real_t r = sqrt(r_squared);
   // printf("Distance between elements: %f <%f, %f, %f>\n", r, dx, dy, dz);
 
   // Calculate the force magnitude
-  const float magnitude = adjusted_constant * mass1 * mass2  / (r_squared);
+  const real_t magnitude = adjusted_constant * mass1 * mass2  / (r_squared);
 
   // Calculate the force components
   // (with error checking for division by zero)
@@ -0,0 +1,205 @@
+/* This file holds the initial condition models.
+   Each element is generated on its own from (seed, element index),
+   see generate_element. */
+
+#include <iostream>
+#include <string>
+#include <math.h> // for sqrt, pow, log, exp, cos, sin
+
+#include "include/parameters.hpp"
+#include "include/distributions.hpp"
+#include "include/rng.hpp"
+
+
+static const char* model_names[] = {
+  "solar", "random", "plummer", "hernquist", "uniform_cube", "disk", "cold_collapse"
+};
+
+bool parse_model(const std::string& name, Model* model) {
+  for (int i = 0; i <= MODEL_COLD_COLLAPSE; i++) {
+    if (name == model_names[i]) {
+      *model = static_cast<Model>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* model_name(Model model) {
+  return model_names[model];
+}
+
+
+// Scales a random isotropic direction to the given length
+static void isotropic_vector(Counter_RNG& rng, double length, double* x, double* y, double* z) {
+  const double cos_theta = rng.uniform(-1, 1);
+  const double sin_theta = sqrt(1 - cos_theta * cos_theta);
+  const double phi = rng.uniform(0, 2 * M_PI);
+  *x = length * sin_theta * cos(phi);
+  *y = length * sin_theta * sin(phi);
+  *z = length * cos_theta;
+}
+
+static void set_values(float values[NUM_VALUES], double x, double y, double z, double vx, double vy, double vz, double mass) {
+  values[0] = x;
+  values[1] = y;
+  values[2] = z;
+  values[3] = vx;
+  values[4] = vy;
+  values[5] = vz;
+  values[6] = mass;
+}
+
+// Scenario 1 (kept from the original generator)
+static void generate_solar(Counter_RNG& rng, long long element, float values[NUM_VALUES]) {
+  if (element == 0) {
+    // The Sun
+    set_values(values, 0, 0, 0, 0, 0, 0, 1e7);
+  } else if (element == 1) {
+    // Earth
+    set_values(values, 1.0, 0, 0, 0, 1.0, 0, 1.0);
+  } else if (element == 2) {
+    // Another Planet
+    const float dist_factor = 1.45;
+    set_values(values, dist_factor, 0, 0, 0, 1.0 / sqrt(dist_factor), 0, 1.0);
+  } else {
+    // The rest of the planets will be randomly placed
+    set_values(values, rng.uniform(), rng.uniform(), rng.uniform(),
+        rng.uniform(), rng.uniform(), rng.uniform(), DEFAULT_MASS);
+  }
+}
+
+// Scenario 2 (kept from the original generator)
+static void generate_random(Counter_RNG& rng, float values[NUM_VALUES]) {
+  set_values(values,
+      5 * rng.uniform(-1, 1), 5 * rng.uniform(-1, 1), 5 * rng.uniform(-1, 1),
+      rng.uniform(-1, 1), rng.uniform(-1, 1), rng.uniform(-1, 1),
+      floor(rng.uniform(0, 10000)) * 1000 * DEFAULT_MASS);
+}
+
+// Plummer sphere (Aarseth, Henon & Wielen 1974)
+static void generate_plummer(Counter_RNG& rng, double gm, double a, double mass, float values[NUM_VALUES]) {
+  // Radius from the inverted cumulative mass (cut at 99.9% of the mass)
+  const double r = a / sqrt(pow(rng.uniform(0, 0.999), -2.0 / 3.0) - 1);
+  double x, y, z;
+  isotropic_vector(rng, r, &x, &y, &z);
+
+  // Speed as a fraction q of the escape speed, g(q) = q^2 (1 - q^2)^3.5
+  double q;
+  do {
+    q = rng.uniform();
+  } while (rng.uniform(0, 0.1) > q * q * pow(1 - q * q, 3.5));
+  const double escape_speed = sqrt(2 * gm / sqrt(r * r + a * a));
+  double vx, vy, vz;
+  isotropic_vector(rng, q * escape_speed, &vx, &vy, &vz);
+
+  set_values(values, x, y, z, vx, vy, vz, mass);
+}
+
+// Hernquist sphere (Hernquist 1990), velocities from the isotropic
+// Jeans dispersion (a local Maxwellian, cut at the escape speed)
+static void generate_hernquist(Counter_RNG& rng, double gm, double a, double mass, float values[NUM_VALUES]) {
+  // Radius from the inverted cumulative mass M(r) = M r^2 / (r + a)^2 (cut at 100 a)
+  const double root = sqrt(rng.uniform(0, (100.0 / 101.0) * (100.0 / 101.0)));
+  const double r = a * root / (1 - root);
+  double x, y, z;
+  isotropic_vector(rng, r, &x, &y, &z);
+
+  const double s = r / a;
+  double dispersion_squared = gm / (12 * a) * (
+      12 * s * pow(1 + s, 3) * log((1 + s) / s)
+      - s / (1 + s) * (25 + 52 * s + 42 * s * s + 12 * s * s * s));
+  if (dispersion_squared < 0) {
+    dispersion_squared = 0;  // (rounding at large radii)
+  }
+  const double dispersion = sqrt(dispersion_squared);
+  const double escape_speed_squared = 2 * gm / (r + a);
+  double vx, vy, vz;
+  do {
+    vx = dispersion * rng.normal();
+    vy = dispersion * rng.normal();
+    vz = dispersion * rng.normal();
+  } while (vx * vx + vy * vy + vz * vz >= escape_speed_squared);
+
+  set_values(values, x, y, z, vx, vy, vz, mass);
+}
+
+// Uniform cube of side 2a, at rest
+static void generate_uniform_cube(Counter_RNG& rng, double a, double mass, float values[NUM_VALUES]) {
+  set_values(values, rng.uniform(-a, a), rng.uniform(-a, a), rng.uniform(-a, a), 0, 0, 0, mass);
+}
+
+// Exponential disk with scale length a (and height 0.05 a) on circular
+// orbits around the enclosed mass, with a 5% velocity dispersion
+static void generate_disk(Counter_RNG& rng, double gm, double a, double mass, float values[NUM_VALUES]) {
+  // Radius from the cumulative mass 1 - (1 + R/a) exp(-R/a) (cut at 10 a)
+  const double max_fraction = 1 - 11 * exp(-10.0);
+  const double fraction = rng.uniform(0, max_fraction);
+  double low = 0, high = 10;
+  for (int iteration = 0; iteration < 60; iteration++) {
+    const double mid = (low + high) / 2;
+    if (1 - (1 + mid) * exp(-mid) < fraction) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  const double radius = a * (low + high) / 2;
+  const double phi = rng.uniform(0, 2 * M_PI);
+  const double z = 0.05 * a * rng.normal();
+
+  // (the enclosed mass is treated as spherical)
+  const double speed = sqrt(gm * fraction / radius);
+  const double vx = -speed * sin(phi) + 0.05 * speed * rng.normal();
+  const double vy = speed * cos(phi) + 0.05 * speed * rng.normal();
+  const double vz = 0.05 * speed * rng.normal();
+
+  set_values(values, radius * cos(phi), radius * sin(phi), z, vx, vy, vz, mass);
+}
+
+// Uniform sphere of radius a, at rest
+static void generate_cold_collapse(Counter_RNG& rng, double a, double mass, float values[NUM_VALUES]) {
+  double x, y, z;
+  isotropic_vector(rng, a * cbrt(rng.uniform()), &x, &y, &z);
+  set_values(values, x, y, z, 0, 0, 0, mass);
+}
+
+
+void generate_element(const Model_Parameters& parameters, long long element, float values[NUM_VALUES]) {
+  Counter_RNG rng(parameters.seed, element, parameters.stream);
+
+  const double gm = GRAVITATIONAL_CONSTANT * GRAVITATIONAL_FORCE_FACTOR * parameters.total_mass;
+  const double a = parameters.scale_radius;
+  const double mass = parameters.total_mass / parameters.num_elements;
+
+  switch (parameters.model) {
+    case MODEL_SOLAR:
+      generate_solar(rng, element, values);
+      break;
+    case MODEL_RANDOM:
+      generate_random(rng, values);
+      break;
+    case MODEL_PLUMMER:
+      generate_plummer(rng, gm, a, mass, values);
+      break;
+    case MODEL_HERNQUIST:
+      generate_hernquist(rng, gm, a, mass, values);
+      break;
+    case MODEL_UNIFORM_CUBE:
+      generate_uniform_cube(rng, a, mass, values);
+      break;
+    case MODEL_DISK:
+      generate_disk(rng, gm, a, mass, values);
+      break;
+    case MODEL_COLD_COLLAPSE:
+      generate_cold_collapse(rng, a, mass, values);
+      break;
+  }
+}
+
+void generate_elements(const Model_Parameters& parameters, long long first, long long count, float* values) {
+  #pragma omp parallel for schedule(static)
+  for (long long i = 0; i < count; i++) {
+    generate_element(parameters, first + i, &values[i * NUM_VALUES]);
+  }
+}
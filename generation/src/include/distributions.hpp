@@ -0,0 +1,44 @@
+#ifndef DISTRIBUTIONS_H
+#define DISTRIBUTIONS_H
+
+#include "parameters.hpp"
+
+#include <stdint.h>
+#include <string>
+
+// Initial condition models
+enum Model {
+  MODEL_SOLAR,          // scenario 1: a sun, two planets, then random elements
+  MODEL_RANDOM,         // scenario 2: random positions, velocities and masses
+  MODEL_PLUMMER,        // Plummer sphere in equilibrium
+  MODEL_HERNQUIST,      // Hernquist sphere (Jeans velocity dispersion)
+  MODEL_UNIFORM_CUBE,   // uniform cube at rest
+  MODEL_DISK,           // rotating exponential disk
+  MODEL_COLD_COLLAPSE   // uniform sphere at rest
+};
+
+struct Model_Parameters {
+  Model model;
+  long long num_elements;
+  uint64_t seed;
+  uint32_t stream = 0;  // separates the systems of an ensemble
+  double total_mass = DEFAULT_TOTAL_MASS;
+  double scale_radius = DEFAULT_SCALE_RADIUS;
+};
+
+// Converts a model name (e.g. "plummer") to a Model, returns false if unknown
+bool parse_model(const std::string& name, Model* model);
+
+// Name of a model (for printing)
+const char* model_name(Model model);
+
+// Generates the values (x, y, z, vx, vy, vz, mass) of one element.
+// Only depends on the parameters and the element index, so elements can
+// be generated in any order, chunk or thread.
+void generate_element(const Model_Parameters& parameters, long long element, float values[NUM_VALUES]);
+
+// Generates count elements from element first on into values
+// (NUM_VALUES floats per element, in parallel)
+void generate_elements(const Model_Parameters& parameters, long long first, long long count, float* values);
+
+#endif  // DISTRIBUTIONS_H
@@ -0,0 +1,24 @@
+#ifndef PARAMETERS_H
+#define PARAMETERS_H
+
+#define DEFAULT_MASS 1.0
+#define NUM_VALUES 7  // x, y, z, vx, vy, vz, mass
+#define DEFAULT_FILENAME "initial_conditions.hdf5"
+
+// Same units as the solver (see computation/src/include/parameters.hpp):
+// 1.0 distance is 1 AU, 1.0 mass is 1 earth mass
+#define GRAVITATIONAL_CONSTANT 6.67430e-11
+#define GRAVITATIONAL_FORCE_FACTOR 1.4982e3
+
+// Elements generated and written per chunk (bounds the memory used)
+#define DEFAULT_CHUNK_SIZE (1 << 20)
+
+#define DEFAULT_NUM_ELEMENTS 16
+#define DEFAULT_SEED 12345
+
+// Model defaults: G * M = 1 and a scale radius of 1
+// (so the velocity scale sqrt(G * M / a) is 1)
+#define DEFAULT_TOTAL_MASS 1e7
+#define DEFAULT_SCALE_RADIUS 1.0
+
+#endif
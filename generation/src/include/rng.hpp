@@ -0,0 +1,84 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+#include <math.h> // for sqrt, log, cos
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al. 2011).
+// Every value is a pure function of (seed, element, stream, draw), so an
+// element gets the same numbers whichever thread or chunk generates it.
+struct Counter_RNG {
+  uint32_t key[2];
+  uint32_t counter[4];  // draw block, element (low, high), stream
+  uint32_t block[4];    // output of the current draw block
+  int used = 4;         // values of block already handed out
+
+  Counter_RNG(uint64_t seed, uint64_t element, uint32_t stream = 0) {
+    this->key[0] = (uint32_t) seed;
+    this->key[1] = (uint32_t) (seed >> 32);
+    this->counter[0] = 0;
+    this->counter[1] = (uint32_t) element;
+    this->counter[2] = (uint32_t) (element >> 32);
+    this->counter[3] = stream;
+  }
+
+  // Next 32 random bits
+  uint32_t next() {
+    if (this->used == 4) {
+      this->generate_block();
+      this->counter[0]++;
+      this->used = 0;
+    }
+    return this->block[this->used++];
+  }
+
+  // Uniform in (0, 1)
+  double uniform() {
+    // (two named draws: the operands of ^ are unsequenced, so a single
+    // expression would order the draws differently between compilers)
+    const uint64_t high = this->next();
+    const uint64_t low = this->next();
+    const uint64_t bits = (high << 21) ^ (low >> 11);  // 53 bits
+    return (bits + 0.5) / 9007199254740992.0;  // 2^53
+  }
+
+  // Uniform in (low, high)
+  double uniform(double low, double high) {
+    return low + (high - low) * this->uniform();
+  }
+
+  // Standard normal (Box-Muller)
+  double normal() {
+    // (named draws, for the same reason as in uniform)
+    const double radius = sqrt(-2 * log(this->uniform()));
+    const double angle = 2 * M_PI * this->uniform();
+    return radius * cos(angle);
+  }
+
+  void generate_block() {
+    uint32_t c[4] = {this->counter[0], this->counter[1], this->counter[2], this->counter[3]};
+    uint32_t k[2] = {this->key[0], this->key[1]};
+    for (int round = 0; round < 10; round++) {
+      const uint64_t product_0 = (uint64_t) 0xD2511F53 * c[0];
+      const uint64_t product_1 = (uint64_t) 0xCD9E8D57 * c[2];
+      const uint32_t next[4] = {
+        (uint32_t) (product_1 >> 32) ^ c[1] ^ k[0],
+        (uint32_t) product_1,
+        (uint32_t) (product_0 >> 32) ^ c[3] ^ k[1],
+        (uint32_t) product_0
+      };
+      c[0] = next[0];
+      c[1] = next[1];
+      c[2] = next[2];
+      c[3] = next[3];
+      k[0] += 0x9E3779B9;
+      k[1] += 0xBB67AE85;
+    }
+    this->block[0] = c[0];
+    this->block[1] = c[1];
+    this->block[2] = c[2];
+    this->block[3] = c[3];
+  }
+};
+
+#endif  // RNG_H
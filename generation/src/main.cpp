@@ -2,118 +2,125 @@
 #include <string>
 #include <H5Cpp.h>
 #include <time.h>
-#include <math.h> // for sqrt
+#include <vector>
+#include <algorithm> // for std::min
+#include <chrono> // for timing (clock() adds up the time of every thread)
+#include <stdlib.h> // for atoi, atoll, strtoull, atof
+
+#include "include/parameters.hpp"
+#include "include/distributions.hpp"
 
 using namespace H5;
 
-#define DEFAULT_MASS 1.0
-#define NUM_VALUES 7  // x, y, z, vx, vy, vz, mass
-#define DEFAULT_FILENAME "initial_conditions.hdf5"
 
-int main(int argc, char *argv[]) {
+// Generates the elements chunk by chunk (in parallel within a chunk)
+// and streams each chunk to a "dataset" in the group, so the memory
+// used only depends on the chunk size.
+static void write_elements(Group& group, const Model_Parameters& parameters, const long long chunk_size) {
+  // Create a dataspace for a dataset
+  // [ element, value ]
+  const hsize_t DIMS[2] = {static_cast<hsize_t>(parameters.num_elements), NUM_VALUES};
+  DataSpace dataspace(2, DIMS);
 
-  const int num_elements = 16;
-  const int scenario = 2;
+  // Store the dataset in chunks matching the generated chunks
+  DSetCreatPropList properties;
+  const hsize_t CHUNK_DIMS[2] = {static_cast<hsize_t>(std::min(chunk_size, parameters.num_elements)), NUM_VALUES};
+  properties.setChunk(2, CHUNK_DIMS);
 
-  std::string filename = DEFAULT_FILENAME;
-  if (argc > 1) {
-    filename = argv[1];
+  // Create a dataset
+  DataSet dataset = group.createDataSet("dataset", PredType::NATIVE_FLOAT, dataspace, properties);
+
+  std::vector<float> data(CHUNK_DIMS[0] * NUM_VALUES);
+  for (long long first = 0; first < parameters.num_elements; first += chunk_size) {
+    const long long count = std::min(chunk_size, parameters.num_elements - first);
+
+    // Fill the chunk with some data
+    generate_elements(parameters, first, count, data.data());
+
+    // Write the chunk to its rows of the dataset
+    const hsize_t offset[2] = {static_cast<hsize_t>(first), 0};
+    const hsize_t size[2] = {static_cast<hsize_t>(count), NUM_VALUES};
+    DataSpace file_space = dataset.getSpace();
+    file_space.selectHyperslab(H5S_SELECT_SET, size, offset);
+    DataSpace memory_space(2, size);
+    dataset.write(data.data(), PredType::NATIVE_FLOAT, memory_space, file_space);
   }
-  filename = "data/" + filename; // prepend "data/" to the filename
-  printf("Writing initial conditions to %s\n", filename.c_str());
-
-  // printf("creating %d elements\n", num_elements);
 
+  dataset.close();
+}
 
-  clock_t start_time, end_time;
-  start_time = clock();
-  
-  // Create a new file
-  H5File file(filename, H5F_ACC_TRUNC); 
+int main(int argc, char *argv[]) {
 
-  // Create a dataspace for a dataset
-  // [ element, value ]
-  const hsize_t DIMS[2] = {num_elements, NUM_VALUES}; 
-  DataSpace dataspace(2, DIMS);
+  // Usage: Generator_exe [filename] [--model name] [--num num_elements] [--seed seed]
+  //                      [--mass total_mass] [--radius scale_radius] [--chunk chunk_size]
+  //                      [--ensemble num_systems]
+  // Models: solar, random, plummer, hernquist, uniform_cube, disk, cold_collapse
+  // (--ensemble writes num_systems systems, each to its own group)
+  Model_Parameters parameters;
+  parameters.model = MODEL_RANDOM;
+  parameters.num_elements = DEFAULT_NUM_ELEMENTS;
+  parameters.seed = DEFAULT_SEED;
+  long long chunk_size = DEFAULT_CHUNK_SIZE;
+  int num_systems = 0;
 
-  // Create a dataset
-  DataSet dataset = file.createDataSet("dataset", PredType::NATIVE_FLOAT, dataspace);
-  
-  // Fill the dataset with some data
-  float data[num_elements][NUM_VALUES];
-
-  if (scenario == 1) {
-    // Element 0 (The Sun)
-    data[0][0] = 0.0;
-    data[0][1] = 0.0;
-    data[0][2] = 0.0;
-    data[0][3] = 0.0;
-    data[0][4] = 0.0;
-    data[0][5] = 0.0;
-    data[0][6] = 1e7; // mass
-
-    // Element 1 (Earth)
-    data[1][0] = 1.0; // x position
-    data[1][1] = 0.0;
-    data[1][2] = 0.0;
-    data[1][3] = 0.0;
-    data[1][4] = 1.0; // y velocity
-    data[1][5] = 0.0;
-    data[1][6] = 1.0; // mass
-
-    // // Element 2 (Earth's Moon)
-    // data[2][0] = 1.0 + 0.0022; // x position +0.0024
-    // data[2][1] = 0.0;
-    // data[2][2] = 0.0;
-    // data[2][3] = 0.0;
-    // data[2][4] = 1.0 + 1/31; // y velocity (1/30 of the velocity of the Earth)
-    // data[2][5] = 0.0;
-    // data[2][6] = 1.0/81; // mass (1/81 of the mass of the Earth)
-
-    // New Element 2 (Another Planet)
-    if (num_elements > 2) {
-      const float dist_factor = 1.45;
-      data[2][0] = 1.0 * dist_factor;
-      data[2][1] = 0.0;
-      data[2][2] = 0.0;
-      data[2][3] = 0.0;
-      data[2][4] = 1.0/sqrt(dist_factor); // 1 / sqrt(2) of the velocity 
-      data[2][5] = 0;
-      data[2][6] = 1.0; // mass
-
-      // The rest of the planets will be randomly placed
-      for (int i = 3; i < num_elements; i++) {
-        data[i][0] = (rand() % 1000) / 1000.0; // x position
-        data[i][1] = (rand() % 1000) / 1000.0; // y position
-        data[i][2] = (rand() % 1000) / 1000.0; // z position
-        data[i][3] = (rand() % 1000) / 1000.0; // x velocity
-        data[i][4] = (rand() % 1000) / 1000.0; // y velocity
-        data[i][5] = (rand() % 1000) / 1000.0; // z velocity
-        data[i][6] = DEFAULT_MASS; // mass
+  std::string filename = DEFAULT_FILENAME;
+  for (int i = 1; i < argc; i++) {
+    std::string argument = argv[i];
+    const bool has_value = (i + 1 < argc);
+    if (argument == "--model" && has_value) {
+      if (!parse_model(argv[++i], &parameters.model)) {
+        printf("Unknown model: %s\n", argv[i]);
+        return 1;
       }
-    }
-  } else if (scenario == 2) {
-    for (int i = 0; i < num_elements; i++) {
-      // random values between -1 and 1
-      data[i][0] = 5 * ((rand() % 1000) / 500.0 - 1); // x position
-      data[i][1] = 5 * ((rand() % 1000) / 500.0 - 1); // y position
-      data[i][2] = 5 * ((rand() % 980) / 500.0 - 1); // z position
-      data[i][3] = (rand() % 1000) / 500.0 - 1; // x velocity
-      data[i][4] = (rand() % 1000) / 500.0 - 1; // y velocity
-      data[i][5] = (rand() % 1000) / 500.0 - 1; // z velocity
-      data[i][6] = (rand() % 10000) * 1000 * DEFAULT_MASS; // mass
+    } else if (argument == "--num" && has_value) {
+      parameters.num_elements = atoll(argv[++i]);
+    } else if (argument == "--seed" && has_value) {
+      parameters.seed = strtoull(argv[++i], nullptr, 10);
+    } else if (argument == "--mass" && has_value) {
+      parameters.total_mass = atof(argv[++i]);
+    } else if (argument == "--radius" && has_value) {
+      parameters.scale_radius = atof(argv[++i]);
+    } else if (argument == "--chunk" && has_value) {
+      chunk_size = atoll(argv[++i]);
+    } else if (argument == "--ensemble" && has_value) {
+      num_systems = atoi(argv[++i]);
+    } else {
+      filename = argument;
     }
   }
+  if (parameters.num_elements < 1 || chunk_size < 1) {
+    printf("The number of elements and the chunk size must be positive\n");
+    return 1;
+  }
+  filename = "data/" + filename; // prepend "data/" to the filename
+  printf("Writing %lld elements (%s, seed %llu) to %s\n", parameters.num_elements,
+      model_name(parameters.model), (unsigned long long) parameters.seed, filename.c_str());
 
 
-  // Write the dataset to the file
-  dataset.write(data, PredType::NATIVE_FLOAT);  
+  auto start_time = std::chrono::steady_clock::now();
 
-  dataset.close();
+  // Create a new file
+  H5File file(filename, H5F_ACC_TRUNC);
+  Group root = file.openGroup("/");
+
+  if (num_systems > 0) {
+    // One group per system, each with its own dataset
+    for (int system = 0; system < num_systems; system++) {
+      char group_name[32];
+      snprintf(group_name, sizeof(group_name), "system_%06d", system);
+      Group group = file.createGroup(group_name);
+      parameters.stream = system;
+      write_elements(group, parameters, chunk_size);
+      group.close();
+    }
+  } else {
+    write_elements(root, parameters, chunk_size);
+  }
+  root.close();
   file.close();
 
-  end_time = clock();
-  double time_taken = double(end_time - start_time) / double(CLOCKS_PER_SEC);
+  auto end_time = std::chrono::steady_clock::now();
+  double time_taken = std::chrono::duration<double>(end_time - start_time).count();
   printf("Done. Time taken: %f seconds.\n", time_taken);
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,50 @@
+/* This file holds the generation stage of the pipeline: the same models as
+   Generator_exe (generation/src), but each run is generated into memory and
+   handed to the solver instead of being written to an HDF5 file.
+   (Only the generator headers are included here, see pipeline.hpp) */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono> // for timing (clock() adds up the time of every thread)
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "include/pipeline.hpp"
+#include "distributions.hpp"
+
+
+bool pipeline_model_exists(const std::string& model) {
+  Model parsed;
+  return parse_model(model, &parsed);
+}
+
+void generate_stage(const std::vector<Pipeline_Run>& runs, Pipeline_Queue<IC_Batch>& ic_queue, int num_threads) {
+#ifdef _OPENMP
+  // (the team size is per thread, so this only limits the generator's team,
+  // which runs next to the solver's)
+  omp_set_num_threads(num_threads);
+#endif
+  for (const Pipeline_Run& run : runs) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    Model_Parameters parameters;
+    parse_model(run.model, &parameters.model);
+    parameters.num_elements = run.num_elements;
+    parameters.seed = run.seed;
+
+    IC_Batch batch;
+    batch.run = run;
+    batch.values.resize(run.num_elements * NUM_VALUES);
+    generate_elements(parameters, 0, run.num_elements, batch.values.data());
+
+    auto end_time = std::chrono::steady_clock::now();
+    printf("[Generate] %s: %lld elements in %f seconds\n", run.name.c_str(), run.num_elements,
+        std::chrono::duration<double>(end_time - start_time).count());
+
+    // (blocks while the solver is queue capacity runs behind)
+    ic_queue.push(std::move(batch));
+  }
+  ic_queue.close();
+}
@@ -0,0 +1,82 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// (no parameters.hpp here: the generator and the solver each have their own,
+// so each stage only includes the headers of its side)
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+// One run of a sweep (initial conditions of one model and seed)
+struct Pipeline_Run {
+  int index;
+  std::string name;   // e.g. plummer_seed12345 (names the result file)
+  std::string model;  // generator model name
+  long long num_elements;
+  uint64_t seed;
+};
+
+// Initial conditions of one run, handed from the generator to the solver
+struct IC_Batch {
+  Pipeline_Run run;
+  std::vector<float> values;  // NUM_VALUES floats per element
+};
+
+
+// Bounded queue between two stages.
+// push blocks while the queue is full (so a fast stage cannot run ahead
+// by more than capacity items), pop blocks until an item arrives and
+// returns false once the queue is closed and empty.
+template <typename T>
+struct Pipeline_Queue {
+  size_t capacity;
+  std::deque<T> items;
+  bool closed = false;
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+
+  Pipeline_Queue(size_t capacity) : capacity(capacity) {}
+
+  void push(T item) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->not_full.wait(lock, [this] { return this->items.size() < this->capacity; });
+    this->items.push_back(std::move(item));
+    this->not_empty.notify_one();
+  }
+
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->not_empty.wait(lock, [this] { return !this->items.empty() || this->closed; });
+    if (this->items.empty()) {
+      return false;
+    }
+    item = std::move(this->items.front());
+    this->items.pop_front();
+    this->not_full.notify_one();
+    return true;
+  }
+
+  // No more items will be pushed
+  void close() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->closed = true;
+    this->not_empty.notify_all();
+  }
+};
+
+
+// defined in generate_stage.cpp
+// Returns false if the generator has no such model
+bool pipeline_model_exists(const std::string& model);
+
+// defined in generate_stage.cpp
+// Generates the initial conditions of every run in memory and pushes them
+// to ic_queue (closed at the end), with num_threads OpenMP threads
+void generate_stage(const std::vector<Pipeline_Run>& runs, Pipeline_Queue<IC_Batch>& ic_queue, int num_threads);
+
+#endif  // PIPELINE_H
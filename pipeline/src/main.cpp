@@ -0,0 +1,261 @@
+/* Pipeline driver: generates, solves and reduces a sweep of runs in one
+   process. The three stages run concurrently and hand their data over
+   through in-memory queues, so the only files written are the final
+   products (one results file per run and a summary of the sweep):
+
+     generate (thread) -> IC queue -> solve (main thread) -> result queue -> output (thread)
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory> // for std::unique_ptr
+#include <thread>
+#include <chrono> // for timing (clock() adds up the time of every thread)
+#include <stdlib.h> // for atoi, atoll, atof, strtoull
+#include <stdio.h> // for FILE
+#include <algorithm> // for std::max
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "include/pipeline.hpp"
+#include "parameters.hpp"  // (the solver's, only Solver_lib's headers are on this side)
+#include "declarations.hpp"
+#include "system.hpp"
+#include "autotune.hpp"
+#include "numa.hpp"
+
+
+// A solved run, handed from the solver to the output stage
+struct Solve_Result {
+  Pipeline_Run run;
+  std::unique_ptr<System> system;
+  std::string solver;
+  double solve_time = 0;
+};
+
+// Comma separated list (e.g. "plummer,hernquist")
+static std::vector<std::string> split_list(const std::string& list) {
+  std::vector<std::string> items;
+  for (size_t start = 0; start < list.size(); ) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    items.push_back(list.substr(start, end - start));
+    start = end + 1;
+  }
+  return items;
+}
+
+// Writes the final products of each run as it arrives
+// (and the summary of the sweep once the solver is done)
+static void output_stage(Pipeline_Queue<Solve_Result>& result_queue, const std::string& summary_filename) {
+  std::vector<std::string> summary;
+  Solve_Result result;
+  while (result_queue.pop(result)) {
+    System& system = *result.system;
+    output_results_HDF5(system, "data/results_" + result.run.name + ".hdf5");
+
+    char line[256];
+    snprintf(line, sizeof(line), "%s %d %s %d %f %e", result.run.name.c_str(), system.num_elements,
+        result.solver.c_str(), system.num_time_steps, result.solve_time, system.diagnostics.energy_drift());
+    summary.push_back(line);
+    printf("[Output] %s\n", line);
+
+    // (frees the run's state before the next one arrives)
+    result.system.reset();
+  }
+
+  FILE* file = fopen(summary_filename.c_str(), "w");
+  if (file == nullptr) {
+    printf("Could not write %s\n", summary_filename.c_str());
+    return;
+  }
+  fprintf(file, "# name num_elements solver num_time_steps solve_seconds energy_drift\n");
+  for (const std::string& line : summary) {
+    fprintf(file, "%s\n", line.c_str());
+  }
+  fclose(file);
+  printf("[Output] Wrote the summary of %d runs to %s\n", (int) summary.size(), summary_filename.c_str());
+}
+
+int main(int argc, char *argv[]) {
+
+  // Usage: Pipeline_exe [--model name[,name...]] [--num num_elements] [--seed seed] [--runs runs_per_model]
+  //                     [--steps num_time_steps] [--solver direct|fmm|pm|auto] [--error-budget E]
+  //                     [--output full|reduced] [--tracers N] [--queue capacity]
+  //                     [--generator-threads N] [--pin none|compact|spread]
+  // Every model is run with the seeds seed, seed + 1, ..., seed + runs_per_model - 1.
+  // The generator runs with generator_threads OpenMP threads (a quarter of
+  // them by default) and the solver with the rest, so the two stages do not
+  // oversubscribe the cpus.
+  const char* usage = "Usage: Pipeline_exe [--model name[,name...]] [--num num_elements] [--seed seed] [--runs runs_per_model]\n"
+                      "                    [--steps num_time_steps] [--solver direct|fmm|pm|auto] [--error-budget E]\n"
+                      "                    [--output full|reduced] [--tracers N] [--queue capacity]\n"
+                      "                    [--generator-threads N] [--pin none|compact|spread]\n";
+  std::vector<std::string> models = {"plummer"};
+  long long num_elements = 1000;
+  uint64_t first_seed = 12345;
+  int runs_per_model = 1;
+  int num_time_steps = 200;
+  std::string solver = "direct";
+  double error_budget = AUTOTUNE_ERROR_BUDGET;
+  Output_Mode output_mode = OUTPUT_REDUCED;  // (a sweep keeps the small products by default)
+  int num_tracers = REDUCTION_NUM_TRACERS;
+  int queue_capacity = 2;
+  int all_threads = 1;
+#ifdef _OPENMP
+  all_threads = omp_get_max_threads();
+#endif
+  int generator_threads = std::max(1, all_threads / 4);
+  for (int i = 1; i < argc; i++) {
+    std::string argument = argv[i];
+    const bool has_value = (i + 1 < argc);
+    if (argument == "--model" && has_value) {
+      models = split_list(argv[++i]);
+    } else if (argument == "--num" && has_value) {
+      num_elements = atoll(argv[++i]);
+    } else if (argument == "--seed" && has_value) {
+      first_seed = strtoull(argv[++i], nullptr, 10);
+    } else if (argument == "--runs" && has_value) {
+      runs_per_model = atoi(argv[++i]);
+    } else if (argument == "--steps" && has_value) {
+      num_time_steps = atoi(argv[++i]);
+    } else if (argument == "--solver" && has_value) {
+      solver = argv[++i];
+      if (solver != "direct" && solver != "fmm" && solver != "pm" && solver != "auto") {
+        printf("Unknown solver: %s\n%s", solver.c_str(), usage);
+        return 1;
+      }
+    } else if (argument == "--error-budget" && has_value) {
+      error_budget = atof(argv[++i]);
+    } else if (argument == "--output" && has_value) {
+      std::string output = argv[++i];
+      if (output != "full" && output != "reduced") {
+        printf("Unknown output: %s\n%s", output.c_str(), usage);
+        return 1;
+      }
+      output_mode = (output == "full") ? OUTPUT_FULL : OUTPUT_REDUCED;
+    } else if (argument == "--tracers" && has_value) {
+      num_tracers = atoi(argv[++i]);
+    } else if (argument == "--queue" && has_value) {
+      queue_capacity = atoi(argv[++i]);
+    } else if (argument == "--generator-threads" && has_value) {
+      generator_threads = atoi(argv[++i]);
+    } else if (argument == "--pin" && has_value) {
+      std::string pinning = argv[++i];
+      if (pinning == "compact") {
+        numa_settings.pinning = PIN_COMPACT;
+      } else if (pinning == "spread") {
+        numa_settings.pinning = PIN_SPREAD;
+      } else if (pinning == "none") {
+        numa_settings.pinning = PIN_NONE;
+      } else {
+        printf("Unknown pinning: %s\n%s", pinning.c_str(), usage);
+        return 1;
+      }
+    } else {
+      printf("Unknown argument: %s\n%s", argument.c_str(), usage);
+      return 1;
+    }
+  }
+  if (num_elements < 2 || runs_per_model < 1 || num_time_steps < 2 || queue_capacity < 1 || generator_threads < 1) {
+    printf("The number of elements, runs, timesteps, generator threads and the queue capacity must be positive\n");
+    return 1;
+  }
+
+  // The solver's team (of the main thread) gets the threads the generator
+  // does not use, and is pinned before any state is allocated
+  const int solver_threads = std::max(1, all_threads - generator_threads);
+#ifdef _OPENMP
+  omp_set_num_threads(solver_threads);
+#endif
+  pin_threads(numa_settings.pinning);
+
+  const float time_step_size = 1.0; // 1 day per timestep
+
+  // The sweep: every model with every seed
+  std::vector<Pipeline_Run> runs;
+  for (const std::string& model : models) {
+    if (!pipeline_model_exists(model)) {
+      printf("Unknown model: %s\n", model.c_str());
+      return 1;
+    }
+    for (int run = 0; run < runs_per_model; run++) {
+      Pipeline_Run pipeline_run;
+      pipeline_run.index = runs.size();
+      pipeline_run.model = model;
+      pipeline_run.num_elements = num_elements;
+      pipeline_run.seed = first_seed + run;
+      pipeline_run.name = model + "_seed" + std::to_string(pipeline_run.seed);
+      runs.push_back(pipeline_run);
+    }
+  }
+  printf("Pipeline: %d runs of %lld elements, %d timesteps, solver %s, %s output\n", (int) runs.size(),
+      num_elements, num_time_steps, solver.c_str(), (output_mode == OUTPUT_FULL) ? "full" : "reduced");
+  printf("Threads: %d generator, %d solver, thread pinning: %s\n", generator_threads, solver_threads,
+      pinning_name(numa_settings.pinning));
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  // The generator and the output stage run next to the solver
+  Pipeline_Queue<IC_Batch> ic_queue(queue_capacity);
+  Pipeline_Queue<Solve_Result> result_queue(queue_capacity);
+  std::thread generator(generate_stage, std::cref(runs), std::ref(ic_queue), generator_threads);
+  std::thread output(output_stage, std::ref(result_queue), std::string("data/pipeline_summary.txt"));
+
+  IC_Batch batch;
+  while (ic_queue.pop(batch)) {
+    const int num_batch_elements = batch.values.size() / NUM_VALUES;
+    float (*ic_data)[NUM_VALUES] = reinterpret_cast<float(*)[NUM_VALUES]>(batch.values.data());
+
+    Solve_Result result;
+    result.run = batch.run;
+    result.system.reset(new System(ic_data, num_batch_elements, num_time_steps, time_step_size, output_mode));
+    System& system = *result.system;
+
+    // Reduced output: num_tracers evenly spaced tracers
+    if (output_mode == OUTPUT_REDUCED) {
+      system.select_tracers(num_tracers);
+    }
+
+    // The auto-tuner calibrates on the first run of each kind of input
+    // (later runs of the same size and clustering reuse its cached profile)
+    result.solver = solver;
+    if (solver == "auto") {
+      Tuning_Profile profile = autotune_solver(ic_data, num_batch_elements, num_time_steps, error_budget, true);
+      apply_tuning_profile(system, profile);
+      result.solver = solver_name(profile.solver);
+    }
+    Solver_Type solver_type = SOLVER_DIRECT;
+    if (result.solver == "fmm") {
+      solver_type = SOLVER_FMM;
+    } else if (result.solver == "pm") {
+      solver_type = SOLVER_PM;
+    }
+
+    // (the initial conditions are copied into the System, so the batch can go)
+    std::vector<float>().swap(batch.values);
+
+    auto solve_start = std::chrono::steady_clock::now();
+    system.start_solver(solver_type);
+    while (system.step()) {
+    }
+    auto solve_end = std::chrono::steady_clock::now();
+    result.solve_time = std::chrono::duration<double>(solve_end - solve_start).count();
+    printf("[Solve] %s: %d timesteps (%s) in %f seconds\n", result.run.name.c_str(), num_time_steps,
+        result.solver.c_str(), result.solve_time);
+
+    result_queue.push(std::move(result));
+  }
+  result_queue.close();
+
+  generator.join();
+  output.join();
+
+  auto end_time = std::chrono::steady_clock::now();
+  printf("Done. Time taken: %f seconds.\n", std::chrono::duration<double>(end_time - start_time).count());
+  return 0;
+}
@@ -16,13 +16,21 @@ def normalize_masses(masses):
     masses_normalized = (masses - mass_min) / (mass_max - mass_min)
     return masses_normalized
   
-def read_input_file(input_file):
+def read_input_file(input_file, group=None):
   # Read in HDF5 file
   with h5py.File(input_file, "r") as file:
 
-    # Get the datasets stored in the file
-    position_dataset = file["positions"]
-    mass_dataset = file["masses"]
+    # Ensemble results hold one group per system
+    if group is not None:
+      file = file[group]
+
+    # Reduced results only hold the trajectories of the tracers
+    if "positions" in file:
+      position_dataset = file["positions"]
+      mass_dataset = file["masses"]
+    else:
+      position_dataset = file["reduced/tracer_positions"]
+      mass_dataset = file["reduced/tracer_masses"]
 
     # convert to numpy arrays
     positions = np.array(position_dataset)
@@ -30,6 +38,35 @@ def read_input_file(input_file):
     return positions, masses
 
 
+# Read one record of the projected density images of a reduced results file
+# (only that record is read, however large the file is)
+def read_density_projections(input_file, record=-1):
+  with h5py.File(input_file, "r") as file:
+    reduced = file["reduced"]
+    timestep = reduced["timestep"][record]
+    extent = np.array(reduced["extent"])
+    projections = {}
+    for name in ["xy", "xz", "yz"]:
+      projections[name] = reduced["projection_" + name][record]
+    return timestep, extent, projections
+
+# Plot the three projections side by side (log scale)
+def plot_density_projections(input_file, output_file, record=-1):
+  timestep, extent, projections = read_density_projections(input_file, record)
+  figure, axes = plt.subplots(1, 3, figsize=(15, 5))
+  # (horizontal and vertical axis of each image, as indices into extent)
+  image_axes = {"xy": (0, 1), "xz": (0, 2), "yz": (1, 2)}
+  for ax, name in zip(axes, ["xy", "xz", "yz"]):
+    u, v = image_axes[name]
+    image = projections[name]
+    floor = image[image > 0].min() if (image > 0).any() else 1
+    ax.imshow(np.log10(np.maximum(image, floor)), origin="lower", cmap="inferno",
+              extent=[extent[2 * u], extent[2 * u + 1], extent[2 * v], extent[2 * v + 1]])
+    ax.set_xlabel(name[0].upper())
+    ax.set_ylabel(name[1].upper())
+  figure.suptitle("Projected mass (log10), timestep " + str(timestep))
+  plt.savefig(output_file, dpi=200)
+  print("Done plotting to", output_file)
 
 
 # Main function
@@ -39,10 +76,20 @@ if __name__ == "__main__":
                         help="Specify the input file (default: data/results.hdf5)")
   parser.add_argument("-o", "--output", type=str, default="data/image.png",
                       help="Specify the output file location (default: data/image.png)")
+  parser.add_argument("-g", "--group", type=str, default=None,
+                      help="Specify the system to plot from an ensemble results file (e.g. system_000000)")
   parser.add_argument("-a", "--animate", action="store_true", default=False,
                       help="Enable animation (default: False)")
+  parser.add_argument("-d", "--density", action="store_true", default=False,
+                      help="Plot the density projections of a reduced results file instead of the trails")
+  parser.add_argument("-r", "--record", type=int, default=-1,
+                      help="Record of the density projections to plot (default: the last one)")
   arguments = parser.parse_args()
 
+  if arguments.density:
+    plot_density_projections(arguments.input, arguments.output, arguments.record)
+    sys.exit(0)
+
   # TODO: make the plotting parameters optional arguments
 
   # Plotting parameters
@@ -61,7 +108,7 @@ if __name__ == "__main__":
   input_file = arguments.input
   output_file = arguments.output
 
-  positions, masses = read_input_file(input_file) 
+  positions, masses = read_input_file(input_file, arguments.group)
   masses_normalized = normalize_masses(masses)
 
   # Get the shape of the data